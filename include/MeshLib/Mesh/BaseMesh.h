@@ -15,26 +15,219 @@
 
 #include <math.h>
 #include <assert.h>
+#include <limits.h>
 #include <iostream>
 #include <fstream>
 #include <list>
 #include <vector>
 #include <map>
+#include <algorithm>
+#include <utility>
+#include <type_traits>
 
 #include "../Geometry/Point.h"
 #include "../Geometry/Point2.h"
 #include "../Parser/StrUtil.h"
+#include "Vertex.h"
+#include "Edge.h"
+#include "Face.h"
+#include "HalfEdge.h"
+#include "ElementPool.h"
+#include "FileWriter.h"
+#include "BinaryMesh.h"
+#include "TextScanner.h"
 
 namespace MeshLib
 {
 
+	/*!
+	 * \brief CHasTraits, whether element class T serializes traits, i.e. has its own _to_string
+	 * instead of the empty one of its base class TBase
+	 */
+	template <typename T, typename TBase>
+	struct CHasTraits
+	{
+		enum
+		{
+			value = !std::is_same<decltype(&T::_to_string), void (TBase::*)()>::value
+		};
+	};
+
+	/*! The text between the first '{' and the following '}', empty if there is none */
+	inline CTextRange braced(const CTextRange &t)
+	{
+		const char *sp = (const char *)memchr(t.s, '{', t.n);
+		if (sp == NULL)
+			return CTextRange();
+		const char *ep = (const char *)memchr(sp, '}', t.s + t.n - sp);
+		if (ep == NULL)
+			return CTextRange();
+		return CTextRange(sp + 1, ep - sp - 1);
+	};
+
+	/*!
+	 * \brief CMFileRecords, the records of one piece of an .m file
+	 *
+	 *  Pieces are parsed independently, their records are then added to the mesh in
+	 *  file order. Trait strings point into the mapped file.
+	 */
+	struct CMFileRecords
+	{
+		std::vector<int> vertexIds;
+		/*! x,y,z per vertex */
+		std::vector<double> points;
+		std::vector<CTextRange> vertexStrings;
+
+		std::vector<int> faceIds;
+		/*! vertex ids of all faces, face i uses [faceStart[i], faceStart[i+1]) */
+		std::vector<int> faceVerts;
+		std::vector<size_t> faceStart;
+		std::vector<CTextRange> faceStrings;
+
+		/*! two vertex ids per edge */
+		std::vector<int> edgeVerts;
+		std::vector<CTextRange> edgeStrings;
+
+		/*! vertex id and face id per corner */
+		std::vector<int> cornerIds;
+		std::vector<CTextRange> cornerStrings;
+
+		/*! parse the lines in [begin, end) */
+		void parse(const char *begin, const char *end)
+		{
+			faceStart.push_back(0);
+			CTextScanner sc(begin, end);
+			for (; !sc.eof(); sc.next_line())
+			{
+				CTextRange w;
+				if (!sc.word(w))
+					continue;
+
+				if (w.n == 6 && memcmp(w.s, "Vertex", 6) == 0)
+				{
+					int id;
+					double p[3] = {0, 0, 0};
+					if (!sc.parse_int(id))
+						continue;
+					for (int i = 0; i < 3; i++)
+						sc.parse_double(p[i]);
+					vertexIds.push_back(id);
+					points.insert(points.end(), p, p + 3);
+					vertexStrings.push_back(braced(sc.rest()));
+				}
+				else if (w.n == 4 && memcmp(w.s, "Face", 4) == 0)
+				{
+					int id, vid;
+					if (!sc.parse_int(id))
+						continue;
+					while (sc.parse_int(vid))
+						faceVerts.push_back(vid);
+					faceIds.push_back(id);
+					faceStart.push_back(faceVerts.size());
+					faceStrings.push_back(braced(sc.rest()));
+				}
+				else if (w.n == 4 && memcmp(w.s, "Edge", 4) == 0)
+				{
+					int id0, id1;
+					if (!sc.parse_int(id0) || !sc.parse_int(id1))
+						continue;
+					edgeVerts.push_back(id0);
+					edgeVerts.push_back(id1);
+					edgeStrings.push_back(braced(sc.rest()));
+				}
+				else if (w.n == 6 && memcmp(w.s, "Corner", 6) == 0)
+				{
+					int vid, fid;
+					if (!sc.parse_int(vid) || !sc.parse_int(fid))
+						continue;
+					cornerIds.push_back(vid);
+					cornerIds.push_back(fid);
+					cornerStrings.push_back(braced(sc.rest()));
+				}
+			}
+		};
+	};
+
+	/*!
+	 * \brief CObjFileRecords, the records of one piece of an .obj file
+	 */
+	struct CObjFileRecords
+	{
+		/*! x,y,z per "v" line */
+		std::vector<double> points;
+		/*! u,v per "vt" line */
+		std::vector<double> uvs;
+		/*! x,y,z per "vn" line */
+		std::vector<double> normals;
+		/*! vertex, uv and normal index per face corner, 0 where missing */
+		std::vector<int> corners;
+		/*! face i uses the corners [faceStart[i], faceStart[i+1]) */
+		std::vector<size_t> faceStart;
+
+		/*! parse the lines in [begin, end) */
+		void parse(const char *begin, const char *end)
+		{
+			faceStart.push_back(0);
+			CTextScanner sc(begin, end);
+			for (; !sc.eof(); sc.next_line())
+			{
+				CTextRange w;
+				if (!sc.word(w))
+					continue;
+
+				if (w.n == 1 && w.s[0] == 'v')
+				{
+					double p[3] = {0, 0, 0};
+					for (int i = 0; i < 3; i++)
+						sc.parse_double(p[i]);
+					points.insert(points.end(), p, p + 3);
+				}
+				else if (w.n == 2 && w.s[0] == 'v' && w.s[1] == 't')
+				{
+					double uv[2] = {0, 0};
+					for (int i = 0; i < 2; i++)
+						sc.parse_double(uv[i]);
+					uvs.insert(uvs.end(), uv, uv + 2);
+				}
+				else if (w.n == 2 && w.s[0] == 'v' && w.s[1] == 'n')
+				{
+					double n[3] = {0, 0, 0};
+					for (int i = 0; i < 3; i++)
+						sc.parse_double(n[i]);
+					normals.insert(normals.end(), n, n + 3);
+				}
+				else if (w.n == 1 && w.s[0] == 'f')
+				{
+					// v, v/vt, v//vn or v/vt/vn per corner
+					while (!sc.eol())
+					{
+						int ids[3] = {0, 0, 0};
+						if (!sc.parse_int(ids[0]))
+						{
+							sc.word(w);
+							continue;
+						}
+						for (int k = 1; k < 3 && sc.skip('/'); k++)
+						{
+							if (sc.peek() != '/')
+								sc.parse_int(ids[k]);
+						}
+						corners.insert(corners.end(), ids, ids + 3);
+					}
+					faceStart.push_back(corners.size() / 3);
+				}
+			}
+		};
+	};
+
 	/*!
 	 * \brief CBaseMesh, base class for all types of mesh classes
 	 *
-	 *  This is the fundamental class for meshes. It includes a list of vertices,
-	 *  a list of edges, a list of faces. All the geometric objects are connected by pointers,
+	 *  This is the fundamental class for meshes. It includes an array of vertices,
+	 *  an array of edges, an array of faces. The elements live in chunked pools, so their
+	 *  pointers are stable, and are found by id through dense id indices. All the geometric objects are connected by pointers,
 	 *  vertex, edge, face are connected by halfedges. The mesh class has file IO functionalities,
-	 *  supporting .obj, .m and .off file formats. It offers Euler operators, each geometric primative
+	 *  supporting .obj, .m and .off file formats, and binary .ply and .stl files. It offers Euler operators, each geometric primative
 	 *  can access its neighbors freely.
 	 *
 	 * \tparam CVertex   vertex   class, derived from MeshLib::CVertex   class
@@ -56,7 +249,7 @@ namespace MeshLib
 		/*!
 		CBaseMesh constructor.
 		*/
-		CBaseMesh() {};
+		CBaseMesh() : m_use_edge_index(false), m_array_stamp(1), m_edge_list_stamp(0), m_vert_list_stamp(0), m_face_list_stamp(0) {};
 		/*!
 		CBasemesh destructor
 		*/
@@ -70,7 +263,7 @@ namespace MeshLib
 
 		// file io
 		/*!
-		Read an .obj file.
+		Read an .obj file. The file is memory mapped and parsed by several threads.
 		\param filename the input .obj file name
 		*/
 		void read_obj(const char *filename);
@@ -81,7 +274,8 @@ namespace MeshLib
 		void write_obj(const char *output);
 
 		/*!
-		Read an .m file.
+		Read an .m file. The file is memory mapped and parsed by several threads,
+		triangle meshes are then built in one pass.
 		\param input the input obj file name
 		*/
 		void read_m(const char *input);
@@ -102,6 +296,22 @@ namespace MeshLib
 		*/
 		void write_off(const char *output);
 
+		/*!
+		Read a binary little endian .ply file of triangles.
+		\param input the input .ply file name
+		*/
+		void read_ply(const char *input);
+		/*!
+		Write a binary little endian .ply file with positions and normals.
+		\param output the output .ply file name
+		*/
+		void write_ply(const char *output);
+		/*!
+		Write a binary .stl file.
+		\param output the output .stl file name
+		*/
+		void write_stl(const char *output);
+
 		// number of vertices, faces, edges
 		/*! number of vertices */
 		int numVertices();
@@ -388,34 +598,107 @@ namespace MeshLib
 
 		/*!
 		List of the edges of the mesh.
+		The list is a copy of edge_array(), refreshed after the mesh gains or loses edges.
 		*/
-		std::list<tEdge> &edges() { return m_edges; };
+		std::list<tEdge> &edges() { return _list_view(m_edges, m_edge_list, m_edge_list_stamp); };
 		/*!
 		List of the faces of the mesh.
+		The list is a copy of face_array(), refreshed after the mesh gains or loses faces.
 		*/
-		std::list<tFace> &faces() { return m_faces; };
+		std::list<tFace> &faces() { return _list_view(m_faces, m_face_list, m_face_list_stamp); };
 		/*!
 		List of the vertices of the mesh.
+		The list is a copy of vertex_array(), refreshed after the mesh gains or loses vertices.
 		*/
-		std::list<tVertex> &vertices() { return m_verts; };
+		std::list<tVertex> &vertices() { return _list_view(m_verts, m_vert_list, m_vert_list_stamp); };
+
+		/*!
+		Array of the edges of the mesh.
+		*/
+		std::vector<tEdge> &edge_array() { return m_edges; };
+		/*!
+		Array of the faces of the mesh.
+		*/
+		std::vector<tFace> &face_array() { return m_faces; };
+		/*!
+		Array of the vertices of the mesh.
+		*/
+		std::vector<tVertex> &vertex_array() { return m_verts; };
 		/*
 			bool with_uv() { return m_with_texture; };
 			bool with_normal() { return m_with_normal; };
 		*/
 	protected:
-		/*! list of edges */
-		std::list<tEdge> m_edges;
-		/*! list of vertices */
-		std::list<tVertex> m_verts;
-		/*! list of faces */
-		std::list<tFace> m_faces;
+		/*! array of edges */
+		std::vector<tEdge> m_edges;
+		/*! array of vertices */
+		std::vector<tVertex> m_verts;
+		/*! array of faces */
+		std::vector<tFace> m_faces;
+
+		/*! list copies handed out by edges(), vertices() and faces() */
+		std::list<tEdge> m_edge_list;
+		std::list<tVertex> m_vert_list;
+		std::list<tFace> m_face_list;
+		/*! bumped whenever an element array changes */
+		unsigned long m_array_stamp;
+		/*! value of m_array_stamp when each list copy was taken */
+		unsigned long m_edge_list_stamp;
+		unsigned long m_vert_list_stamp;
+		unsigned long m_face_list_stamp;
+
+		/*! refresh a list copy of an element array if the array changed since it was taken */
+		template <typename T>
+		std::list<T> &_list_view(const std::vector<T> &arr, std::list<T> &copy, unsigned long &stamp)
+		{
+			if (stamp != m_array_stamp)
+			{
+				copy.assign(arr.begin(), arr.end());
+				stamp = m_array_stamp;
+			}
+			return copy;
+		};
 
 		// maps
 
-		/*! map between vetex and its id*/
-		std::map<int, tVertex> m_map_vert;
-		/*! map between face and its id*/
-		std::map<int, tFace> m_map_face;
+		/*! index between vetex and its id*/
+		CIdIndex<CVertex> m_map_vert;
+		/*! index between face and its id*/
+		CIdIndex<CFace> m_map_face;
+
+		// storage
+
+		/*! vertex storage */
+		CElementPool<CVertex> m_vert_pool;
+		/*! edge storage */
+		CElementPool<CEdge> m_edge_pool;
+		/*! face storage */
+		CElementPool<CFace> m_face_pool;
+		/*! halfedge storage */
+		CElementPool<CHalfEdge> m_halfedge_pool;
+
+		/*! remove the vertices without a halfedge */
+		void _remove_dangling_vertices();
+		/*! create the faces of indexed triangles over the given vertices, as createFace would
+			\param faceIds id per face, NULL for 1..n
+			*/
+		template <typename TIndex>
+		void _build_triangles(const std::vector<tVertex> &verts, const std::vector<TIndex> &triangles, const int *faceIds);
+		template <typename TIndex>
+		static bool _valid_indices(const std::vector<TIndex> &triangles, size_t nv);
+		/*! float positions, normals and 0-based triangles for the binary writers */
+		void _to_indexed(std::vector<float> &positions, std::vector<float> &normals, std::vector<uint32_t> &triangles);
+
+		// edge index
+
+		/*! whether createEdge and vertexEdge use the edge index */
+		bool m_use_edge_index;
+		/*! hash between the ordered vertex id pair and the edge */
+		CKeyIndex<CEdge *> m_edge_index;
+		/*! key of the edge between two vertices */
+		static unsigned long long _edge_key(tVertex v0, tVertex v1);
+		/*! look up the edge between two vertices in the edge index */
+		tEdge _indexed_edge(tVertex v0, tVertex v1);
 
 	public:
 		/*! Create a vertex
@@ -447,6 +730,49 @@ namespace MeshLib
 		*/
 		void deleteFace(tFace pFace);
 
+		/*! Allocate an unlinked halfedge, for topology operators */
+		tHalfEdge allocHalfEdge();
+		/*! Allocate an unlinked edge and add it to the mesh, for topology operators */
+		tEdge allocEdge();
+		/*! Allocate an unlinked face and add it to the mesh, for topology operators
+		\param id face id
+		*/
+		tFace allocFace(int id);
+
+		/*! Turn the edge index on or off. With the index, createEdge and vertexEdge
+		find an edge in constant time instead of scanning the edge list of a vertex,
+		which matters for high valence vertices.
+		\param on whether to use the index
+		*/
+		void useEdgeIndex(bool on);
+		/*! Register an edge under its current end vertices, after a topology operator
+		changed them or linked a new edge by hand
+		\param e the edge
+		*/
+		void indexEdge(tEdge e);
+		/*! Drop the index entry of an edge under its current end vertices; call it
+		before a topology operator moves the edge to other vertices
+		\param e the edge
+		*/
+		void unindexEdge(tEdge e);
+
+		/*! Build the mesh from indexed triangles in one pass. Equivalent to calling
+		createVertex and createFace in order, but pairs the halfedges by sorting the
+		directed edges once instead of searching the vertex edge lists.
+		\param positions x,y,z per vertex; vertex i gets id i+1
+		\param triangles three 0-based vertex indices per face; face j gets id j+1
+		\return false, leaving the mesh empty, if an index is out of range
+		*/
+		template <typename TReal, typename TIndex>
+		bool build_from_indexed(const std::vector<TReal> &positions, const std::vector<TIndex> &triangles);
+		/*! Build the mesh from indexed triangles in one pass, with one point per vertex
+		\param points vertex i gets id i+1
+		\param triangles three 0-based vertex indices per face; face j gets id j+1
+		\return false, leaving the mesh empty, if an index is out of range
+		*/
+		template <typename TIndex>
+		bool build_from_indexed(const std::vector<CPoint> &points, const std::vector<TIndex> &triangles);
+
 		/*! whether the vertex is with texture coordinates */
 		bool m_with_texture;
 		/*! whether the mesh is with normal */
@@ -840,44 +1166,44 @@ namespace MeshLib
 	{
 		// remove vertices
 
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
 		{
 			CVertex *pV = *viter;
-			delete pV;
+			m_vert_pool.release(pV);
 		}
 		m_verts.clear();
 
 		// remove faces
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		std::vector<CHalfEdge *> hes;
+		for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
 		{
 			CFace *pF = *fiter;
 
 			tHalfEdge he = faceHalfedge(pF);
 
-			std::list<CHalfEdge *> hes;
 			do
 			{
 				he = halfedgeNext(he);
 				hes.push_back(he);
 			} while (he != pF->halfedge());
 
-			for (std::list<CHalfEdge *>::iterator hiter = hes.begin(); hiter != hes.end(); hiter++)
+			for (std::vector<CHalfEdge *>::iterator hiter = hes.begin(); hiter != hes.end(); hiter++)
 			{
 				CHalfEdge *pH = *hiter;
-				delete pH;
+				m_halfedge_pool.release(pH);
 			}
 			hes.clear();
 
-			delete pF;
+			m_face_pool.release(pF);
 		}
 		m_faces.clear();
 
 		// remove edges
-		for (std::list<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); eiter++)
+		for (std::vector<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); eiter++)
 		{
 			CEdge *pE = *eiter;
-			delete pE;
+			m_edge_pool.release(pE);
 		}
 
 		m_edges.clear();
@@ -909,11 +1235,12 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	CVertex *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::createVertex(int id)
 	{
-		CVertex *v = new CVertex();
+		CVertex *v = m_vert_pool.allocate();
 		assert(v != NULL);
 		v->id() = id;
 		m_verts.push_back(v);
-		m_map_vert.insert(std::pair<int, CVertex *>(id, v));
+		m_array_stamp++;
+		m_map_vert.insert(id, v);
 		return v;
 	};
 
@@ -925,108 +1252,74 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::read_obj(const char *filename)
 	{
-
-		std::fstream f(filename, std::fstream::in);
-		if (f.fail())
+		CFileMapping file(filename);
+		if (file.fail())
 			return;
 
-		char cmd[1024];
+		// parse line aligned pieces of the file in parallel
+		std::vector<const char *> bounds = CTextScanner::split(file.data(), file.data() + file.size(), CTextScanner::num_pieces(file.size()));
+		std::vector<CObjFileRecords> pieces(bounds.size() - 1);
+		CTextScanner::parallel(pieces.size(), [&](size_t i)
+							   { pieces[i].parse(bounds[i], bounds[i + 1]); });
 
 		int vid = 1;
 		int fid = 1;
 
-		bool with_uv = false;
-		bool with_normal = false;
-
 		std::vector<CPoint2> uvs;
 		std::vector<CPoint> normals;
 
-		while (f.getline(cmd, 1024))
+		size_t nv = 0;
+		for (size_t k = 0; k < pieces.size(); k++)
 		{
-			std::string line(cmd);
-			line = strutil::trim(line);
-
-			strutil::Tokenizer stokenizer(line, " \t\r\n");
-
-			stokenizer.nextToken();
-			std::string token = stokenizer.getToken();
+			const CObjFileRecords &r = pieces[k];
+			nv += r.points.size() / 3;
+			for (size_t i = 0; i < r.uvs.size(); i += 2)
+				uvs.push_back(CPoint2(r.uvs[i], r.uvs[i + 1]));
+			for (size_t i = 0; i < r.normals.size(); i += 3)
+				normals.push_back(CPoint(r.normals[i], r.normals[i + 1], r.normals[i + 2]));
+		}
+		bool with_uv = !uvs.empty();
+		bool with_normal = !normals.empty();
 
-			if (token == "v")
+		m_verts.reserve(m_verts.size() + nv);
+		for (size_t k = 0; k < pieces.size(); k++)
+		{
+			const CObjFileRecords &r = pieces[k];
+			for (size_t i = 0; i < r.points.size(); i += 3)
 			{
-				CPoint p;
-				for (int i = 0; i < 3; i++)
-				{
-					stokenizer.nextToken();
-					token = stokenizer.getToken();
-					p[i] = strutil::parseString<float>(token);
-				}
-
 				CVertex *v = createVertex(vid);
-				v->point() = p;
+				v->point() = CPoint(r.points[i], r.points[i + 1], r.points[i + 2]);
 				vid++;
-				continue;
-			}
-
-			if (token == "vt")
-			{
-				with_uv = true;
-				CPoint2 uv;
-				for (int i = 0; i < 2; i++)
-				{
-					stokenizer.nextToken();
-					token = stokenizer.getToken();
-					uv[i] = strutil::parseString<float>(token);
-				}
-				uvs.push_back(uv);
-				continue;
-			}
-
-			if (token == "vn")
-			{
-				with_normal = true;
-
-				CPoint n;
-				for (int i = 0; i < 3; i++)
-				{
-					stokenizer.nextToken();
-					token = stokenizer.getToken();
-					n[i] = strutil::parseString<float>(token);
-				}
-				normals.push_back(n);
-				continue;
 			}
+		}
 
-			if (token == "f")
+		// faces are added one by one in file order, since faces that would make the
+		// mesh non-manifold are skipped
+		std::vector<CVertex *> face_vertices;
+		std::vector<CVertex *> filtered;
+		for (size_t k = 0; k < pieces.size(); k++)
+		{
+			const CObjFileRecords &r = pieces[k];
+			for (size_t fi = 0; fi + 1 < r.faceStart.size(); fi++)
 			{
-				std::vector<CVertex *> face_vertices;
-				while (stokenizer.nextToken())
+				face_vertices.clear();
+				for (size_t c = r.faceStart[fi]; c < r.faceStart[fi + 1]; c++)
 				{
-					token = stokenizer.getToken();
-					strutil::Tokenizer tokenizer(token, " /\t\r\n");
-					int ids[3] = {0, 0, 0};
-					int k = 0;
-
-					while (tokenizer.nextToken() && k < 3)
-					{
-						std::string token_str = tokenizer.getToken();
-						ids[k] = strutil::parseString<int>(token_str);
-						k++;
-					}
-
-					if (k > 0 && ids[0] > 0)
+					const int *ids = &r.corners[3 * c];
+					if (ids[0] > 0)
 					{
-						CVertex *vertex = m_map_vert[ids[0]];
+						CVertex *vertex = m_map_vert.find(ids[0]);
 						if (vertex == NULL)
 						{
 							continue;
 						}
 
-						if (with_uv && k > 1 && ids[1] > 0)
+						if (with_uv && ids[1] > 0)
 						{
 							if (ids[1] - 1 < (int)uvs.size())
 								vertex->uv() = uvs[ids[1] - 1];
 						}
-						if (with_normal && k > 2 && ids[2] > 0)
+						if (with_normal && ids[2] > 0)
 						{
 							if (ids[2] - 1 < (int)normals.size())
 								vertex->normal() = normals[ids[2] - 1];
@@ -1039,8 +1332,7 @@ namespace MeshLib
 					continue;
 
 				// remove consecutive duplicates and closing duplicate
-				std::vector<CVertex*> filtered;
-				filtered.reserve(face_vertices.size());
+				filtered.clear();
 				for (size_t i = 0; i < face_vertices.size(); ++i)
 				{
 					if (filtered.empty() || filtered.back() != face_vertices[i])
@@ -1085,8 +1377,6 @@ namespace MeshLib
 			}
 		}
 
-		f.close();
-
 		labelBoundary();
 	}
 
@@ -1099,18 +1389,15 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	CFace *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::createFace(tVertex v[], int id)
 	{
-		CFace *f = new CFace();
+		CFace *f = allocFace(id);
 		assert(f != NULL);
-		f->id() = id;
-		m_faces.push_back(f);
-		m_map_face.insert(std::pair<int, tFace>(id, f));
 
 		// create halfedges
 		tHalfEdge hes[3];
 
 		for (int i = 0; i < 3; i++)
 		{
-			hes[i] = new CHalfEdge;
+			hes[i] = allocHalfEdge();
 			assert(hes[i]);
 			CVertex *vert = v[i];
 			hes[i]->vertex() = vert;
@@ -1159,7 +1446,7 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	CVertex *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::idVertex(int id)
 	{
-		return m_map_vert[id];
+		return m_map_vert.find(id);
 	};
 
 	// access v->id
@@ -1183,7 +1470,7 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	CFace *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::idFace(int id)
 	{
-		return m_map_face[id];
+		return m_map_face.find(id);
 	};
 
 	// acess f->id
@@ -1210,6 +1497,18 @@ namespace MeshLib
 		tVertex pV = (v1->id() < v2->id()) ? v1 : v2;
 		std::list<CEdge *> &ledges = (std::list<CEdge *> &)pV->edges();
 
+		if (m_use_edge_index)
+		{
+			CEdge *pE = _indexed_edge(v1, v2);
+			if (pE != NULL)
+				return pE;
+
+			pE = allocEdge();
+			ledges.push_back(pE);
+			m_edge_index[_edge_key(v1, v2)] = pE;
+			return pE;
+		}
+
 		for (std::list<CEdge *>::iterator te = ledges.begin(); te != ledges.end(); te++)
 		{
 			CEdge *pE = *te;
@@ -1226,9 +1525,8 @@ namespace MeshLib
 		}
 
 		// new edge
-		CEdge *e = new CEdge;
+		CEdge *e = allocEdge();
 		assert(e != NULL);
-		m_edges.push_back(e);
 		ledges.push_back(e);
 
 		return e;
@@ -1246,6 +1544,9 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	inline CEdge *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::vertexEdge(tVertex v0, tVertex v1)
 	{
+		if (m_use_edge_index)
+			return _indexed_edge(v0, v1);
+
 		CVertex *pV = (v0->id() < v1->id()) ? v0 : v1;
 		std::list<CEdge *> &ledges = vertexEdges(pV);
 
@@ -1314,150 +1615,143 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::read_m(const char *input)
 	{
-		std::fstream is(input, std::fstream::in);
+		CFileMapping file(input);
 
-		if (is.fail())
+		if (file.fail())
 		{
 			fprintf(stderr, "Error in opening file %s\n", input);
 			return;
 		}
 
-		char buffer[MAX_LINE];
-		int id;
+		// parse line aligned pieces of the file in parallel
+		std::vector<const char *> bounds = CTextScanner::split(file.data(), file.data() + file.size(), CTextScanner::num_pieces(file.size()));
+		std::vector<CMFileRecords> pieces(bounds.size() - 1);
+		CTextScanner::parallel(pieces.size(), [&](size_t i)
+							   { pieces[i].parse(bounds[i], bounds[i + 1]); });
 
-		while (is.getline(buffer, MAX_LINE))
+		size_t nv = 0, nf = 0;
+		bool triangles = true;
+		for (size_t k = 0; k < pieces.size(); k++)
 		{
+			const CMFileRecords &r = pieces[k];
+			nv += r.vertexIds.size();
+			nf += r.faceIds.size();
+			for (size_t i = 0; i < r.faceIds.size() && triangles; i++)
+				triangles = r.faceStart[i + 1] - r.faceStart[i] == 3;
+		}
+		m_verts.reserve(m_verts.size() + nv);
 
-			std::string line(buffer);
-			line = strutil::trim(line);
-
-			strutil::Tokenizer stokenizer(line, " \r\n");
-
-			stokenizer.nextToken();
-			std::string token = stokenizer.getToken();
-
-			if (token == "Vertex")
+		// vertices in file order; dense ids also map to their position for the bulk build
+		std::vector<tVertex> verts;
+		std::vector<unsigned int> index;
+		verts.reserve(nv);
+		for (size_t k = 0; k < pieces.size(); k++)
+		{
+			const CMFileRecords &r = pieces[k];
+			for (size_t i = 0; i < r.vertexIds.size(); i++)
 			{
-				stokenizer.nextToken();
-				token = stokenizer.getToken();
-				id = strutil::parseString<int>(token);
-
-				CPoint p;
-				for (int i = 0; i < 3; i++)
-				{
-					stokenizer.nextToken();
-					token = stokenizer.getToken();
-					p[i] = strutil::parseString<float>(token);
-				}
-
+				int id = r.vertexIds[i];
 				tVertex v = createVertex(id);
-				v->point() = p;
+				v->point() = CPoint(r.points[3 * i], r.points[3 * i + 1], r.points[3 * i + 2]);
 				v->id() = id;
+				if (r.vertexStrings[i].n > 0)
+					v->string() = r.vertexStrings[i].str();
 
-				if (!stokenizer.nextToken("\t\r\n"))
-					continue;
-				token = stokenizer.getToken();
-
-				int sp = (int)token.find("{");
-				int ep = (int)token.find("}");
-
-				if (sp >= 0 && ep >= 0)
+				if (triangles && id >= 0 && (size_t)id < 2 * nv + 1024)
 				{
-					v->string() = token.substr(sp + 1, ep - sp - 1);
+					if ((size_t)id >= index.size())
+						index.resize(id + 1 + id / 2, UINT_MAX);
+					triangles = index[id] == UINT_MAX;
+					index[id] = (unsigned int)verts.size();
 				}
-				continue;
+				else
+					triangles = false;
+				verts.push_back(v);
 			}
+		}
 
-			if (token == "Face")
+		// triangle meshes with dense vertex ids are built in one pass, others face by face
+		size_t firstFace = m_faces.size();
+		std::vector<unsigned int> tris;
+		std::vector<int> faceIds;
+		if (triangles && m_faces.empty())
+		{
+			tris.reserve(3 * nf);
+			faceIds.reserve(nf);
+			for (size_t k = 0; k < pieces.size() && triangles; k++)
 			{
-
-				stokenizer.nextToken();
-				token = stokenizer.getToken();
-				id = strutil::parseString<int>(token);
-
-				std::vector<CVertex *> v;
-				while (stokenizer.nextToken())
+				const CMFileRecords &r = pieces[k];
+				faceIds.insert(faceIds.end(), r.faceIds.begin(), r.faceIds.end());
+				for (size_t i = 0; i < r.faceVerts.size() && triangles; i++)
 				{
-					token = stokenizer.getToken();
-					if (strutil::startsWith(token, "{"))
-						break;
-					int vid = strutil::parseString<int>(token);
-					v.push_back(idVertex(vid));
+					int id = r.faceVerts[i];
+					triangles = id >= 0 && (size_t)id < index.size() && index[id] != UINT_MAX;
+					if (triangles)
+						tris.push_back(index[id]);
 				}
-
-				tFace f = createFace(v, id);
-
-				if (strutil::startsWith(token, "{"))
+			}
+		}
+		if (triangles && m_faces.empty())
+		{
+			_build_triangles(verts, tris, faceIds.empty() ? NULL : &faceIds[0]);
+		}
+		else
+		{
+			for (size_t k = 0; k < pieces.size(); k++)
+			{
+				const CMFileRecords &r = pieces[k];
+				for (size_t i = 0; i < r.faceIds.size(); i++)
 				{
-					f->string() = strutil::trim(token, "{}");
+					std::vector<CVertex *> v;
+					for (size_t j = r.faceStart[i]; j < r.faceStart[i + 1]; j++)
+						v.push_back(idVertex(r.faceVerts[j]));
+					createFace(v, r.faceIds[i]);
 				}
-				continue;
 			}
+		}
+		std::vector<int>().swap(faceIds);
+		std::vector<unsigned int>().swap(tris);
 
-			// read in edge attributes
-			if (token == "Edge")
+		// face, edge and corner attributes
+		size_t fi = firstFace;
+		for (size_t k = 0; k < pieces.size(); k++)
+		{
+			const CMFileRecords &r = pieces[k];
+			for (size_t i = 0; i < r.faceIds.size(); i++, fi++)
 			{
-				stokenizer.nextToken();
-				token = stokenizer.getToken();
-				int id0 = strutil::parseString<int>(token);
-
-				stokenizer.nextToken();
-				token = stokenizer.getToken();
-				int id1 = strutil::parseString<int>(token);
-
-				CVertex *v0 = idVertex(id0);
-				CVertex *v1 = idVertex(id1);
-
-				tEdge edge = vertexEdge(v0, v1);
+				if (r.faceStrings[i].n > 0)
+					m_faces[fi]->string() = r.faceStrings[i].str();
+			}
+		}
 
-				if (!stokenizer.nextToken("\t\r\n"))
+		for (size_t k = 0; k < pieces.size(); k++)
+		{
+			const CMFileRecords &r = pieces[k];
+			for (size_t i = 0; i < r.edgeStrings.size(); i++)
+			{
+				if (r.edgeStrings[i].n == 0)
 					continue;
-				token = stokenizer.getToken();
-
-				int sp = (int)token.find("{");
-				int ep = (int)token.find("}");
-
-				if (sp >= 0 && ep >= 0)
-				{
-					edge->string() = token.substr(sp + 1, ep - sp - 1);
-				}
-				continue;
+				CVertex *v0 = idVertex(r.edgeVerts[2 * i]);
+				CVertex *v1 = idVertex(r.edgeVerts[2 * i + 1]);
+				tEdge edge = vertexEdge(v0, v1);
+				edge->string() = r.edgeStrings[i].str();
 			}
-
-			// read in edge attributes
-			if (token == "Corner")
+			for (size_t i = 0; i < r.cornerStrings.size(); i++)
 			{
-				stokenizer.nextToken();
-				token = stokenizer.getToken();
-				int vid = strutil::parseString<int>(token);
-
-				stokenizer.nextToken();
-				token = stokenizer.getToken();
-				int fid = strutil::parseString<int>(token);
-
-				CVertex *v = idVertex(vid);
-				CFace *f = idFace(fid);
-				tHalfEdge he = corner(v, f);
-
-				if (!stokenizer.nextToken("\t\r\n"))
+				if (r.cornerStrings[i].n == 0)
 					continue;
-				token = stokenizer.getToken();
-
-				int sp = (int)token.find("{");
-				int ep = (int)token.find("}");
-
-				if (sp >= 0 && ep >= 0)
-				{
-					he->string() = token.substr(sp + 1, ep - sp - 1);
-				}
-				continue;
+				CVertex *v = idVertex(r.cornerIds[2 * i]);
+				CFace *f = idFace(r.cornerIds[2 * i + 1]);
+				tHalfEdge he = corner(v, f);
+				he->string() = r.cornerStrings[i].str();
 			}
 		}
+		pieces.clear();
 
 		// labelBoundary();
 
 		// Label boundary edges
-		for (std::list<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); ++eiter)
+		for (std::vector<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); ++eiter)
 		{
 			CEdge *edge = *eiter;
 			CHalfEdge *he[2];
@@ -1486,28 +1780,12 @@ namespace MeshLib
 			}
 		}
 
-		std::list<CVertex *> dangling_verts;
-		// Label boundary edges
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); ++viter)
-		{
-			CVertex *v = *viter;
-			if (v->halfedge() != NULL)
-				continue;
-			dangling_verts.push_back(v);
-		}
-
-		for (std::list<CVertex *>::iterator viter = dangling_verts.begin(); viter != dangling_verts.end(); ++viter)
-		{
-			CVertex *v = *viter;
-			m_verts.remove(v);
-			delete v;
-			v = NULL;
-		}
+		_remove_dangling_vertices();
 
 		// Arrange the boundary half_edge of boundary vertices, to make its halfedge
 		// to be the most ccw in half_edge
 
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); ++viter)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); ++viter)
 		{
 			CVertex *v = *viter;
 			if (!v->boundary())
@@ -1523,25 +1801,25 @@ namespace MeshLib
 
 		// read in the traits
 
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); ++viter)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); ++viter)
 		{
 			CVertex *v = *viter;
 			v->_from_string();
 		}
 
-		for (std::list<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); ++eiter)
+		for (std::vector<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); ++eiter)
 		{
 			CEdge *e = *eiter;
 			e->_from_string();
 		}
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); ++fiter)
+		for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); ++fiter)
 		{
 			CFace *f = *fiter;
 			f->_from_string();
 		}
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
 		{
 			CFace *pF = *fiter;
 
@@ -1561,37 +1839,49 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::write_m(const char *output)
 	{
-		// write traits to string
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		// write traits to string, skipping element types without traits
+		if (CHasTraits<CVertex, MeshLib::CVertex>::value)
 		{
-			CVertex *pV = *viter;
-			pV->_to_string();
+			for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+			{
+				CVertex *pV = *viter;
+				pV->_to_string();
+			}
 		}
 
-		for (std::list<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); eiter++)
+		if (CHasTraits<CEdge, MeshLib::CEdge>::value)
 		{
-			CEdge *pE = *eiter;
-			pE->_to_string();
+			for (std::vector<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); eiter++)
+			{
+				CEdge *pE = *eiter;
+				pE->_to_string();
+			}
 		}
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		if (CHasTraits<CFace, MeshLib::CFace>::value)
 		{
-			CFace *pF = *fiter;
-			pF->_to_string();
+			for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+			{
+				CFace *pF = *fiter;
+				pF->_to_string();
+			}
 		}
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		if (CHasTraits<CHalfEdge, MeshLib::CHalfEdge>::value)
 		{
-			CFace *pF = *fiter;
-			CHalfEdge *pH = faceMostCcwHalfEdge(pF);
-			do
+			for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
 			{
-				pH->_to_string();
-				pH = faceNextCcwHalfEdge(pH);
-			} while (pH != faceMostCcwHalfEdge(pF));
+				CFace *pF = *fiter;
+				CHalfEdge *pH = faceMostCcwHalfEdge(pF);
+				do
+				{
+					pH->_to_string();
+					pH = faceNextCcwHalfEdge(pH);
+				} while (pH != faceMostCcwHalfEdge(pF));
+			}
 		}
 
-		std::fstream _os(output, std::fstream::out);
+		CFileWriter _os(output);
 		if (_os.fail())
 		{
 			fprintf(stderr, "Error is opening file %s\n", output);
@@ -1599,7 +1889,7 @@ namespace MeshLib
 		}
 
 		// remove vertices
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
 		{
 			tVertex v = *viter;
 
@@ -1613,10 +1903,10 @@ namespace MeshLib
 			{
 				_os << " " << "{" << v->string() << "}";
 			}
-			_os << std::endl;
+			_os << '\n';
 		}
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
 		{
 			tFace f = *fiter;
 
@@ -1632,20 +1922,20 @@ namespace MeshLib
 			{
 				_os << " " << "{" << f->string() << "}";
 			}
-			_os << std::endl;
+			_os << '\n';
 		}
 
-		for (std::list<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); eiter++)
+		for (std::vector<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); eiter++)
 		{
 			tEdge e = *eiter;
 			if (e->string().size() > 0)
 			{
 				_os << "Edge " << edgeVertex1(e)->id() << " " << edgeVertex2(e)->id() << " ";
-				_os << "{" << e->string() << "}" << std::endl;
+				_os << "{" << e->string() << "}" << '\n';
 			}
 		}
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
 		{
 			tFace f = *fiter;
 
@@ -1656,7 +1946,7 @@ namespace MeshLib
 				if (he->string().size() > 0)
 				{
 					_os << "Corner " << he->vertex()->id() << " " << f->id() << " ";
-					_os << "{" << he->string() << "}" << std::endl;
+					_os << "{" << he->string() << "}" << '\n';
 				}
 				he = halfedgeNext(he);
 			} while (he != f->halfedge());
@@ -1673,7 +1963,7 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::write_obj(const char *output)
 	{
-		std::fstream _os(output, std::fstream::out);
+		CFileWriter _os(output);
 		if (_os.fail())
 		{
 			fprintf(stderr, "Error is opening file %s\n", output);
@@ -1681,13 +1971,13 @@ namespace MeshLib
 		}
 
 		int vid = 1;
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
 		{
 			tVertex v = *viter;
 			v->id() = vid++;
 		}
 
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
 		{
 			tVertex v = *viter;
 
@@ -1697,10 +1987,10 @@ namespace MeshLib
 			{
 				_os << " " << v->point()[i];
 			}
-			_os << std::endl;
+			_os << '\n';
 		}
 
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
 		{
 			tVertex v = *viter;
 
@@ -1710,10 +2000,10 @@ namespace MeshLib
 			{
 				_os << " " << v->uv()[i];
 			}
-			_os << std::endl;
+			_os << '\n';
 		}
 
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
 		{
 			tVertex v = *viter;
 
@@ -1723,10 +2013,10 @@ namespace MeshLib
 			{
 				_os << " " << v->normal()[i];
 			}
-			_os << std::endl;
+			_os << '\n';
 		}
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
 		{
 			tFace f = *fiter;
 
@@ -1740,7 +2030,7 @@ namespace MeshLib
 				_os << " " << vid << "/" << vid << "/" << vid;
 				he = halfedgeNext(he);
 			} while (he != f->halfedge());
-			_os << std::endl;
+			_os << '\n';
 		}
 
 		_os.close();
@@ -1753,31 +2043,31 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::write_off(const char *output)
 	{
-		std::fstream _os(output, std::fstream::out);
+		CFileWriter _os(output);
 		if (_os.fail())
 		{
 			fprintf(stderr, "Error is opening file %s\n", output);
 			return;
 		}
 
-		_os << "OFF" << std::endl;
-		_os << m_verts.size() << " " << m_faces.size() << " " << m_edges.size() << std::endl;
+		_os << "OFF" << '\n';
+		_os << m_verts.size() << " " << m_faces.size() << " " << m_edges.size() << '\n';
 
 		int vid = 0;
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
 		{
 			tVertex v = *viter;
 			v->id() = vid++;
 		}
 
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); viter++)
 		{
 			tVertex v = *viter;
-			_os << v->point()[0] << " " << v->point()[1] << " " << v->point()[2] << std::endl;
-			//_os << v->normal()[0] << " " << v->normal()[1]<< " " << v->normal()[2]<< std::endl;
+			_os << v->point()[0] << " " << v->point()[1] << " " << v->point()[2] << '\n';
+			//_os << v->normal()[0] << " " << v->normal()[1]<< " " << v->normal()[2]<< '\n';
 		}
 
-		for (std::list<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
 		{
 			tFace f = *fiter;
 
@@ -1791,12 +2081,104 @@ namespace MeshLib
 				_os << " " << vid;
 				he = halfedgeNext(he);
 			} while (he != f->halfedge());
-			_os << std::endl;
+			_os << '\n';
 		}
 
 		_os.close();
 	};
 
+	/*!
+		Read a binary little endian .ply file of triangles.
+		\param input the input .ply file name
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::read_ply(const char *input)
+	{
+		std::vector<float> positions, normals;
+		std::vector<uint32_t> triangles;
+		if (!read_ply_binary(input, positions, normals, triangles))
+			return;
+
+		if (!build_from_indexed(positions, triangles))
+			return;
+		if (normals.size() == positions.size())
+		{
+			for (size_t i = 0; i < m_verts.size(); i++)
+				m_verts[i]->normal() = CPoint(normals[3 * i], normals[3 * i + 1], normals[3 * i + 2]);
+		}
+
+		labelBoundary();
+	};
+
+	/*!
+		Collect float positions, normals and 0-based triangle indices, vertex ids are set to 1..n
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::_to_indexed(std::vector<float> &positions, std::vector<float> &normals, std::vector<uint32_t> &triangles)
+	{
+		positions.resize(3 * m_verts.size());
+		normals.resize(3 * m_verts.size());
+		for (size_t i = 0; i < m_verts.size(); i++)
+		{
+			tVertex v = m_verts[i];
+			v->id() = (int)i + 1;
+			for (int k = 0; k < 3; k++)
+			{
+				positions[3 * i + k] = (float)v->point()[k];
+				normals[3 * i + k] = (float)v->normal()[k];
+			}
+		}
+
+		triangles.clear();
+		triangles.reserve(3 * m_faces.size());
+		for (std::vector<CFace *>::iterator fiter = m_faces.begin(); fiter != m_faces.end(); fiter++)
+		{
+			tFace f = *fiter;
+			// the face halfedge ends at the last vertex given to createFace, start after it
+			// so that the vertex order round trips; polygons are split into triangle fans
+			tHalfEdge first = halfedgeNext(faceHalfedge(f));
+			tHalfEdge he = first;
+			uint32_t v0 = he->target()->id() - 1;
+			he = halfedgeNext(he);
+			uint32_t v1 = he->target()->id() - 1;
+			for (he = halfedgeNext(he); he != first; he = halfedgeNext(he))
+			{
+				uint32_t v2 = he->target()->id() - 1;
+				triangles.push_back(v0);
+				triangles.push_back(v1);
+				triangles.push_back(v2);
+				v1 = v2;
+			}
+		}
+	};
+
+	/*!
+		Write a binary little endian .ply file with positions and normals.
+		\param output the output .ply file name
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::write_ply(const char *output)
+	{
+		std::vector<float> positions, normals;
+		std::vector<uint32_t> triangles;
+		_to_indexed(positions, normals, triangles);
+		write_ply_binary(output, positions.empty() ? NULL : &positions[0], normals.empty() ? NULL : &normals[0], m_verts.size(),
+						 triangles.empty() ? NULL : &triangles[0], triangles.size() / 3);
+	};
+
+	/*!
+		Write a binary .stl file.
+		\param output the output .stl file name
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::write_stl(const char *output)
+	{
+		std::vector<float> positions, normals;
+		std::vector<uint32_t> triangles;
+		_to_indexed(positions, normals, triangles);
+		write_stl_binary(output, positions.empty() ? NULL : &positions[0], triangles.empty() ? NULL : &triangles[0], triangles.size() / 3);
+	};
+
 	// template pointer converting to base class pointer is OK (BasePointer) = (TemplatePointer)
 	//(TemplatePointer)=(BasePointer) is incorrect
 	/*! delete one face
@@ -1806,12 +2188,12 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::deleteFace(tFace pFace)
 	{
-		std::map<int, tFace>::iterator fiter = m_map_face.find(pFace->id());
-		if (fiter != m_map_face.end())
+		if (m_map_face.find(pFace->id()) == pFace)
 		{
-			m_map_face.erase(fiter);
+			m_map_face.erase(pFace->id());
 		}
-		m_faces.remove(pFace);
+		m_faces.erase(std::remove(m_faces.begin(), m_faces.end(), pFace), m_faces.end());
+		m_array_stamp++;
 
 		// create halfedges
 		tHalfEdge hes[3];
@@ -1852,20 +2234,28 @@ namespace MeshLib
 			if (pS == NULL)
 			{
 				// assert(0);
-				m_edges.remove(pE);
+				m_edges.erase(std::remove(m_edges.begin(), m_edges.end(), pE), m_edges.end());
+				m_array_stamp++;
 				CVertex *v0 = halfedgeSource(pH);
 				CVertex *v1 = halfedgeTarget(pH);
-				delete pE;
+				vertexEdges(v0->id() < v1->id() ? v0 : v1).remove(pE);
+				if (m_use_edge_index)
+				{
+					CEdge **pI = m_edge_index.find(_edge_key(v0, v1));
+					if (pI != NULL && *pI == pE)
+						m_edge_index.erase(_edge_key(v0, v1));
+				}
+				m_edge_pool.release(pE);
 			}
 		}
 
 		// remove half edges
 		for (int i = 0; i < 3; i++)
 		{
-			delete hes[i];
+			m_halfedge_pool.release(hes[i]);
 		}
 
-		delete pFace;
+		m_face_pool.release(pFace);
 	};
 
 	/*!
@@ -1978,7 +2368,7 @@ namespace MeshLib
 	{
 
 		// Label boundary edges
-		for (std::list<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); ++eiter)
+		for (std::vector<CEdge *>::iterator eiter = m_edges.begin(); eiter != m_edges.end(); ++eiter)
 		{
 			CEdge *edge = *eiter;
 			CHalfEdge *he[2];
@@ -2007,28 +2397,12 @@ namespace MeshLib
 			}
 		}
 
-		std::list<CVertex *> dangling_verts;
-		// Label boundary edges
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); ++viter)
-		{
-			tVertex v = *viter;
-			if (v->halfedge() != NULL)
-				continue;
-			dangling_verts.push_back(v);
-		}
-
-		for (std::list<CVertex *>::iterator viter = dangling_verts.begin(); viter != dangling_verts.end(); ++viter)
-		{
-			tVertex v = *viter;
-			m_verts.remove(v);
-			delete v;
-			v = NULL;
-		}
+		_remove_dangling_vertices();
 
 		// Arrange the boundary half_edge of boundary vertices, to make its halfedge
 		// to be the most ccw in half_edge
 
-		for (std::list<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); ++viter)
+		for (std::vector<CVertex *>::iterator viter = m_verts.begin(); viter != m_verts.end(); ++viter)
 		{
 			tVertex v = *viter;
 			if (!v->boundary())
@@ -2043,6 +2417,311 @@ namespace MeshLib
 		}
 	};
 
+	/*! Allocate an unlinked halfedge
+		\return pointer to the new halfedge
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	CHalfEdge *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::allocHalfEdge()
+	{
+		return m_halfedge_pool.allocate();
+	};
+
+	/*! Allocate an unlinked edge and add it to the edge array
+		\return pointer to the new edge
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	CEdge *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::allocEdge()
+	{
+		CEdge *e = m_edge_pool.allocate();
+		m_edges.push_back(e);
+		m_array_stamp++;
+		return e;
+	};
+
+	/*! Allocate an unlinked face and add it to the face array and id index
+		\param id face id
+		\return pointer to the new face
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	CFace *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::allocFace(int id)
+	{
+		CFace *f = m_face_pool.allocate();
+		f->id() = id;
+		m_faces.push_back(f);
+		m_array_stamp++;
+		m_map_face.insert(id, f);
+		return f;
+	};
+
+	/*! Turn the edge index on or off
+		\param on whether to use the index
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::useEdgeIndex(bool on)
+	{
+		m_edge_index.clear();
+		m_use_edge_index = on;
+		if (!on)
+			return;
+		for (size_t i = 0; i < m_edges.size(); i++)
+		{
+			indexEdge(m_edges[i]);
+		}
+	};
+
+	/*! Register an edge under its current end vertices
+		\param e the edge
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::indexEdge(tEdge e)
+	{
+		if (!m_use_edge_index || e->halfedge(0) == NULL)
+			return;
+		CHalfEdge *pH = (CHalfEdge *)e->halfedge(0);
+		m_edge_index[_edge_key((CVertex *)pH->source(), (CVertex *)pH->target())] = e;
+	};
+
+	/*! Drop the index entry of an edge under its current end vertices
+		\param e the edge
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::unindexEdge(tEdge e)
+	{
+		if (!m_use_edge_index || e->halfedge(0) == NULL)
+			return;
+		CHalfEdge *pH = (CHalfEdge *)e->halfedge(0);
+		unsigned long long key = _edge_key((CVertex *)pH->source(), (CVertex *)pH->target());
+		CEdge **pI = m_edge_index.find(key);
+		if (pI != NULL && *pI == e)
+			m_edge_index.erase(key);
+	};
+
+	/*! Key of the edge between two vertices, from the ordered id pair
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	inline unsigned long long CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::_edge_key(tVertex v0, tVertex v1)
+	{
+		unsigned int a = (unsigned int)v0->id();
+		unsigned int b = (unsigned int)v1->id();
+		return (a < b) ? ((unsigned long long)a << 32) | b : ((unsigned long long)b << 32) | a;
+	};
+
+	/*! Look up the edge between two vertices in the edge index
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	inline CEdge *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::_indexed_edge(tVertex v0, tVertex v1)
+	{
+		CEdge **pI = m_edge_index.find(_edge_key(v0, v1));
+		if (pI == NULL)
+			return NULL;
+		CEdge *pE = *pI;
+		CHalfEdge *pH = (CHalfEdge *)pE->halfedge(0);
+		assert(pH == NULL || (pH->source() == v0 && pH->target() == v1) || (pH->source() == v1 && pH->target() == v0));
+		return pE;
+	};
+
+	/*! Remove the vertices without a halfedge, keeping the order of the others
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::_remove_dangling_vertices()
+	{
+		size_t n = 0;
+		for (size_t i = 0; i < m_verts.size(); i++)
+		{
+			tVertex v = m_verts[i];
+			if (v->halfedge() != NULL)
+			{
+				m_verts[n++] = v;
+				continue;
+			}
+			if (m_map_vert.find(v->id()) == v)
+				m_map_vert.erase(v->id());
+			m_vert_pool.release(v);
+		}
+		m_verts.resize(n);
+		m_array_stamp++;
+	};
+
+	/*! Build the mesh from indexed triangles in one pass.
+		\param positions x,y,z per vertex; vertex i gets id i+1
+		\param triangles three 0-based vertex indices per face; face j gets id j+1
+		\return false, leaving the mesh empty, if an index is out of range
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	template <typename TReal, typename TIndex>
+	bool CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::build_from_indexed(const std::vector<TReal> &positions, const std::vector<TIndex> &triangles)
+	{
+		assert(m_verts.empty() && m_faces.empty());
+
+		size_t nv = positions.size() / 3;
+		if (!_valid_indices(triangles, nv))
+			return false;
+		m_verts.reserve(nv);
+
+		std::vector<tVertex> verts(nv);
+		for (size_t i = 0; i < nv; i++)
+		{
+			CVertex *v = createVertex((int)i + 1);
+			v->point() = CPoint(positions[3 * i], positions[3 * i + 1], positions[3 * i + 2]);
+			verts[i] = v;
+		}
+
+		_build_triangles(verts, triangles, NULL);
+		return true;
+	}
+
+	/*! Build the mesh from indexed triangles in one pass.
+		\param points vertex i gets id i+1
+		\param triangles three 0-based vertex indices per face; face j gets id j+1
+		\return false, leaving the mesh empty, if an index is out of range
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	template <typename TIndex>
+	bool CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::build_from_indexed(const std::vector<CPoint> &points, const std::vector<TIndex> &triangles)
+	{
+		assert(m_verts.empty() && m_faces.empty());
+
+		size_t nv = points.size();
+		if (!_valid_indices(triangles, nv))
+			return false;
+		m_verts.reserve(nv);
+
+		std::vector<tVertex> verts(nv);
+		for (size_t i = 0; i < nv; i++)
+		{
+			CVertex *v = createVertex((int)i + 1);
+			v->point() = points[i];
+			verts[i] = v;
+		}
+
+		_build_triangles(verts, triangles, NULL);
+		return true;
+	}
+
+	/*! Check that every triangle index refers to one of nv vertices
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	template <typename TIndex>
+	bool CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::_valid_indices(const std::vector<TIndex> &triangles, size_t nv)
+	{
+		for (size_t i = 0; i < triangles.size() / 3 * 3; i++)
+		{
+			if (triangles[i] < 0 || (size_t)triangles[i] >= nv)
+			{
+				fprintf(stderr, "Error: face %d has an invalid vertex index\n", (int)(i / 3) + 1);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	/*! create the faces of indexed triangles over the given vertices, as createFace would
+		\param verts the vertices the indices refer to
+		\param triangles three 0-based vertex indices per face
+		\param faceIds id per face, NULL for 1..n
+		*/
+	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
+	template <typename TIndex>
+	void CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::_build_triangles(const std::vector<tVertex> &verts, const std::vector<TIndex> &triangles, const int *faceIds)
+	{
+		size_t nv = verts.size();
+		size_t nh = triangles.size() / 3 * 3;
+
+		m_faces.reserve(m_faces.size() + nh / 3);
+		m_edges.reserve(m_edges.size() + nh / 2 + nh / 3 + 1);
+
+		// faces and halfedges, linked exactly as createFace does
+		std::vector<tHalfEdge> hes(nh);
+		for (size_t j = 0; j < nh; j += 3)
+		{
+			CFace *f = allocFace(faceIds != NULL ? faceIds[j / 3] : (int)(j / 3) + 1);
+
+			for (int i = 0; i < 3; i++)
+			{
+				assert((size_t)triangles[j + i] < nv);
+				tHalfEdge pH = allocHalfEdge();
+				CVertex *vert = verts[triangles[j + i]];
+				pH->vertex() = vert;
+				vert->halfedge() = pH;
+				pH->face() = f;
+				hes[j + i] = pH;
+			}
+			for (int i = 0; i < 3; i++)
+			{
+				hes[j + i]->he_next() = hes[j + (i + 1) % 3];
+				hes[j + i]->he_prev() = hes[j + (i + 2) % 3];
+			}
+			f->halfedge() = hes[j + 2];
+		}
+
+		// sort the halfedges by their edge key (smaller, larger vertex index) with
+		// two stable counting sorts, by the larger index and then by the smaller;
+		// twins become adjacent, in halfedge order, and are paired in one pass.
+		// The first halfedge of a run creates the edge, as in createEdge
+		std::vector<unsigned int> lo(nh), hi(nh);
+		for (size_t h = 0; h < nh; h++)
+		{
+			unsigned int a = (unsigned int)triangles[h];
+			unsigned int b = (unsigned int)triangles[h - h % 3 + (h + 2) % 3];
+			lo[h] = std::min(a, b);
+			hi[h] = std::max(a, b);
+		}
+		std::vector<unsigned int> byHi(nh), bucket(nh);
+		{
+			std::vector<size_t> fill(nv + 1, 0);
+			for (size_t h = 0; h < nh; h++)
+				fill[hi[h] + 1]++;
+			for (size_t i = 0; i < nv; i++)
+				fill[i + 1] += fill[i];
+			for (size_t h = 0; h < nh; h++)
+				byHi[fill[hi[h]]++] = (unsigned int)h;
+
+			std::fill(fill.begin(), fill.end(), 0);
+			for (size_t h = 0; h < nh; h++)
+				fill[lo[h] + 1]++;
+			for (size_t i = 0; i < nv; i++)
+				fill[i + 1] += fill[i];
+			for (size_t k = 0; k < nh; k++)
+			{
+				unsigned int h = byHi[k];
+				bucket[fill[lo[h]]++] = h;
+			}
+		}
+
+		std::vector<unsigned int> first(nh);
+		for (size_t k = 0; k < nh; k++)
+		{
+			unsigned int h = bucket[k];
+			unsigned int p = k > 0 ? bucket[k - 1] : h;
+			first[h] = (k > 0 && lo[p] == lo[h] && hi[p] == hi[h]) ? first[p] : h;
+		}
+
+		// create the edges in the order createFace would have
+		for (size_t h = 0; h < nh; h++)
+		{
+			tHalfEdge pH = hes[h];
+			if (first[h] == h)
+			{
+				CEdge *e = allocEdge();
+				CVertex *v1 = (CVertex *)pH->vertex();
+				CVertex *v2 = (CVertex *)pH->he_prev()->vertex();
+				tVertex pV = (v1->id() < v2->id()) ? v1 : v2;
+				pV->edges().push_back(e);
+				e->halfedge(0) = pH;
+				pH->edge() = e;
+				indexEdge(e);
+				continue;
+			}
+			tEdge e = (tEdge)hes[first[h]]->edge();
+			if (e->halfedge(1) != NULL)
+			{
+				std::cout << "Illegal Face Construction " << (faceIds != NULL ? faceIds[h / 3] : (int)(h / 3) + 1) << std::endl;
+			}
+			e->halfedge(1) = pH;
+			pH->edge() = e;
+		}
+	}
+
 	/*! Create a face
 		\param v an array of vertices
 		\param id face id
@@ -2052,18 +2731,15 @@ namespace MeshLib
 	template <typename CVertex, typename CEdge, typename CFace, typename CHalfEdge>
 	CFace *CBaseMesh<CVertex, CEdge, CFace, CHalfEdge>::createFace(std::vector<tVertex> &v, int id)
 	{
-		CFace *f = new CFace();
+		CFace *f = allocFace(id);
 		assert(f != NULL);
-		f->id() = id;
-		m_faces.push_back(f);
-		m_map_face.insert(std::pair<int, tFace>(id, f));
 
 		// create halfedges
 		std::vector<tHalfEdge> hes;
 
 		for (size_t i = 0; i < v.size(); i++)
 		{
-			tHalfEdge pH = new CHalfEdge;
+			tHalfEdge pH = allocHalfEdge();
 			assert(pH);
 			CVertex *vert = v[i];
 			pH->vertex() = vert;
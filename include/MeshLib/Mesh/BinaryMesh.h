@@ -0,0 +1,459 @@
+/*!
+ *      \file BinaryMesh.h
+ *      \brief Binary PLY and STL files for indexed triangle meshes
+ *
+ *	   The records are written and read in host byte order, which is little endian
+ *	   on all the supported platforms.
+ */
+
+#ifndef _MESHLIB_BINARY_MESH_H_
+#define _MESHLIB_BINARY_MESH_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#include "FileWriter.h"
+#include "FileMapping.h"
+
+namespace MeshLib
+{
+
+	/*!
+	Write a binary little endian .ply file.
+	\param output the output .ply file name
+	\param positions x,y,z per vertex
+	\param normals x,y,z per vertex, NULL to leave out the normals
+	\param numVertices number of vertices
+	\param triangles three 0-based vertex indices per triangle
+	\param numTriangles number of triangles
+	\return false if the file could not be opened
+	*/
+	inline bool write_ply_binary(const char *output, const float *positions, const float *normals, size_t numVertices,
+								 const uint32_t *triangles, size_t numTriangles)
+	{
+		CFileWriter _os(output, true);
+		if (_os.fail())
+		{
+			fprintf(stderr, "Error is opening file %s\n", output);
+			return false;
+		}
+
+		_os << "ply\nformat binary_little_endian 1.0\n";
+		_os << "element vertex " << (unsigned long long)numVertices << '\n';
+		_os << "property float x\nproperty float y\nproperty float z\n";
+		if (normals != NULL)
+			_os << "property float nx\nproperty float ny\nproperty float nz\n";
+		_os << "element face " << (unsigned long long)numTriangles << '\n';
+		_os << "property list uchar int vertex_indices\nend_header\n";
+
+		for (size_t i = 0; i < numVertices; i++)
+		{
+			_os.write(positions + 3 * i, 3 * sizeof(float));
+			if (normals != NULL)
+				_os.write(normals + 3 * i, 3 * sizeof(float));
+		}
+
+		char record[13];
+		record[0] = 3;
+		for (size_t i = 0; i < numTriangles; i++)
+		{
+			memcpy(record + 1, triangles + 3 * i, 3 * sizeof(uint32_t));
+			_os.write(record, sizeof(record));
+		}
+
+		_os.close();
+		return true;
+	};
+
+	/*!
+	Write a binary .stl file, facet normals are computed from the triangles.
+	\param output the output .stl file name
+	\param positions x,y,z per vertex
+	\param triangles three 0-based vertex indices per triangle
+	\param numTriangles number of triangles
+	\return false if the file could not be opened
+	*/
+	inline bool write_stl_binary(const char *output, const float *positions, const uint32_t *triangles, size_t numTriangles)
+	{
+		CFileWriter _os(output, true);
+		if (_os.fail())
+		{
+			fprintf(stderr, "Error is opening file %s\n", output);
+			return false;
+		}
+
+		char header[80];
+		memset(header, 0, sizeof(header));
+		strcpy(header, "binary STL");
+		_os.write(header, sizeof(header));
+		uint32_t n = (uint32_t)numTriangles;
+		_os.write(&n, sizeof(n));
+
+		// 12 floats and a 16 bit attribute count per facet
+		char record[50];
+		memset(record, 0, sizeof(record));
+		for (size_t i = 0; i < numTriangles; i++)
+		{
+			const float *p[3];
+			for (int j = 0; j < 3; j++)
+				p[j] = positions + 3 * triangles[3 * i + j];
+
+			float a[3], b[3], nm[3];
+			for (int k = 0; k < 3; k++)
+			{
+				a[k] = p[1][k] - p[0][k];
+				b[k] = p[2][k] - p[0][k];
+			}
+			nm[0] = a[1] * b[2] - a[2] * b[1];
+			nm[1] = a[2] * b[0] - a[0] * b[2];
+			nm[2] = a[0] * b[1] - a[1] * b[0];
+			float len = sqrtf(nm[0] * nm[0] + nm[1] * nm[1] + nm[2] * nm[2]);
+			if (len > 0)
+			{
+				for (int k = 0; k < 3; k++)
+					nm[k] /= len;
+			}
+
+			memcpy(record, nm, sizeof(nm));
+			for (int j = 0; j < 3; j++)
+				memcpy(record + 12 + 12 * j, p[j], 3 * sizeof(float));
+			_os.write(record, sizeof(record));
+		}
+
+		_os.close();
+		return true;
+	};
+
+	/*!
+	 * \brief CPlyHeader, element layout of a binary .ply file
+	 */
+	struct CPlyHeader
+	{
+		/*! scalar types of the format, the value is the size in bytes */
+		enum
+		{
+			INT8 = 1,
+			INT16 = 2,
+			INT32 = 4,
+			FLOAT32 = 0x14,
+			FLOAT64 = 0x18,
+			UNSIGNED = 0x100,
+			INVALID = 0
+		};
+
+		struct Property
+		{
+			std::string name;
+			int type;
+			/*! type of the item count, INVALID for scalar properties */
+			int countType;
+		};
+
+		struct Element
+		{
+			std::string name;
+			size_t count;
+			std::vector<Property> props;
+		};
+
+		/*! size of a scalar type in bytes */
+		static size_t size(int type) { return (size_t)(type & 0xF); };
+
+		/*! scalar type by its .ply name */
+		static int type(const std::string &s)
+		{
+			if (s == "char" || s == "int8")
+				return INT8;
+			if (s == "uchar" || s == "uint8")
+				return INT8 | UNSIGNED;
+			if (s == "short" || s == "int16")
+				return INT16;
+			if (s == "ushort" || s == "uint16")
+				return INT16 | UNSIGNED;
+			if (s == "int" || s == "int32")
+				return INT32;
+			if (s == "uint" || s == "uint32")
+				return INT32 | UNSIGNED;
+			if (s == "float" || s == "float32")
+				return FLOAT32;
+			if (s == "double" || s == "float64")
+				return FLOAT64;
+			return INVALID;
+		};
+
+		/*! read a scalar value */
+		static double value(const char *p, int type)
+		{
+			switch (type)
+			{
+			case INT8: return (double)*(const int8_t *)p;
+			case INT8 | UNSIGNED: return (double)*(const uint8_t *)p;
+			}
+			union
+			{
+				int16_t i16;
+				uint16_t u16;
+				int32_t i32;
+				uint32_t u32;
+				float f;
+				double d;
+			} v;
+			memcpy(&v, p, size(type));
+			switch (type)
+			{
+			case INT16: return v.i16;
+			case INT16 | UNSIGNED: return v.u16;
+			case INT32: return v.i32;
+			case INT32 | UNSIGNED: return v.u32;
+			case FLOAT32: return v.f;
+			default: return v.d;
+			}
+		};
+
+		/*!
+		Parse the header.
+		\param data the file contents
+		\param size the file size
+		\return offset of the first element record, 0 if the header is not a binary little endian .ply header
+		*/
+		size_t parse(const char *data, size_t size)
+		{
+			elements.clear();
+			size_t pos = 0;
+			bool binary = false;
+			int lineNo = 0;
+			while (pos < size)
+			{
+				size_t end = pos;
+				while (end < size && data[end] != '\n')
+					end++;
+				std::string line(data + pos, end - pos);
+				pos = end + 1;
+				if (!line.empty() && line[line.size() - 1] == '\r')
+					line.erase(line.size() - 1);
+
+				std::vector<std::string> tokens;
+				size_t i = 0;
+				while (i < line.size())
+				{
+					while (i < line.size() && line[i] == ' ')
+						i++;
+					size_t j = i;
+					while (j < line.size() && line[j] != ' ')
+						j++;
+					if (j > i)
+						tokens.push_back(line.substr(i, j - i));
+					i = j;
+				}
+
+				if (lineNo++ == 0)
+				{
+					if (line != "ply")
+						return 0;
+					continue;
+				}
+				if (tokens.empty() || tokens[0] == "comment" || tokens[0] == "obj_info")
+					continue;
+				if (tokens[0] == "end_header")
+					return binary && pos <= size ? pos : 0;
+				if (tokens[0] == "format")
+				{
+					binary = tokens.size() > 1 && tokens[1] == "binary_little_endian";
+				}
+				else if (tokens[0] == "element" && tokens.size() == 3)
+				{
+					Element e;
+					e.name = tokens[1];
+					e.count = (size_t)strtoull(tokens[2].c_str(), NULL, 10);
+					elements.push_back(e);
+				}
+				else if (tokens[0] == "property" && !elements.empty())
+				{
+					Property p;
+					if (tokens.size() == 5 && tokens[1] == "list")
+					{
+						p.countType = type(tokens[2]);
+						p.type = type(tokens[3]);
+						p.name = tokens[4];
+						if (p.countType == INVALID)
+							return 0;
+					}
+					else if (tokens.size() == 3)
+					{
+						p.countType = INVALID;
+						p.type = type(tokens[1]);
+						p.name = tokens[2];
+					}
+					else
+						return 0;
+					if (p.type == INVALID)
+						return 0;
+					elements.back().props.push_back(p);
+				}
+			}
+			return 0;
+		};
+
+		std::vector<Element> elements;
+	};
+
+	/*!
+	Read a binary little endian .ply file through a memory mapping. Polygons are split
+	into triangle fans, elements other than vertex and face are skipped.
+	\param input the input .ply file name
+	\param positions x,y,z per vertex
+	\param normals x,y,z per vertex, left empty if the file has no nx,ny,nz properties
+	\param triangles three 0-based vertex indices per triangle
+	\return false if the file could not be read
+	*/
+	inline bool read_ply_binary(const char *input, std::vector<float> &positions, std::vector<float> &normals,
+								std::vector<uint32_t> &triangles)
+	{
+		positions.clear();
+		normals.clear();
+		triangles.clear();
+
+		CFileMapping file(input);
+		if (file.fail())
+		{
+			fprintf(stderr, "Error is opening file %s\n", input);
+			return false;
+		}
+
+		CPlyHeader header;
+		const char *data = file.data();
+		const char *end = data + file.size();
+		size_t offset = header.parse(data, file.size());
+		if (offset == 0)
+		{
+			fprintf(stderr, "Error: %s is not a binary little endian .ply file\n", input);
+			return false;
+		}
+
+		const char *p = data + offset;
+		for (size_t e = 0; e < header.elements.size(); e++)
+		{
+			const CPlyHeader::Element &elem = header.elements[e];
+			const std::vector<CPlyHeader::Property> &props = elem.props;
+
+			if (elem.name == "vertex")
+			{
+				// fixed size records, with the offsets of the coordinates and normals
+				static const char *names[6] = {"x", "y", "z", "nx", "ny", "nz"};
+				int type[6] = {0, 0, 0, 0, 0, 0};
+				size_t at[6] = {0, 0, 0, 0, 0, 0};
+				size_t stride = 0;
+				for (size_t i = 0; i < props.size(); i++)
+				{
+					if (props[i].countType != CPlyHeader::INVALID)
+					{
+						fprintf(stderr, "Error: %s has a list vertex property\n", input);
+						return false;
+					}
+					for (int k = 0; k < 6; k++)
+					{
+						if (props[i].name == names[k])
+						{
+							type[k] = props[i].type;
+							at[k] = stride;
+						}
+					}
+					stride += CPlyHeader::size(props[i].type);
+				}
+				if (!type[0] || !type[1] || !type[2] || (size_t)(end - p) / (stride ? stride : 1) < elem.count)
+				{
+					fprintf(stderr, "Error: %s has an invalid vertex element\n", input);
+					return false;
+				}
+				bool hasNormals = type[3] && type[4] && type[5];
+				int nk = hasNormals ? 6 : 3;
+
+				positions.resize(3 * elem.count);
+				if (hasNormals)
+					normals.resize(3 * elem.count);
+				bool allFloat = true;
+				for (int k = 0; k < nk; k++)
+					allFloat = allFloat && type[k] == CPlyHeader::FLOAT32;
+
+				for (size_t i = 0; i < elem.count; i++, p += stride)
+				{
+					for (int k = 0; k < nk; k++)
+					{
+						float *dst = (k < 3 ? &positions[3 * i] : &normals[3 * i]) + k % 3;
+						if (allFloat)
+							memcpy(dst, p + at[k], sizeof(float));
+						else
+							*dst = (float)CPlyHeader::value(p + at[k], type[k]);
+					}
+				}
+				continue;
+			}
+
+			bool isFace = elem.name == "face";
+			if (isFace)
+				triangles.reserve(3 * elem.count);
+			size_t i, j;
+			for (i = 0; i < elem.count; i++)
+			{
+				for (j = 0; j < props.size(); j++)
+				{
+					const CPlyHeader::Property &prop = props[j];
+					size_t sz = CPlyHeader::size(prop.type);
+					if (prop.countType == CPlyHeader::INVALID)
+					{
+						if ((size_t)(end - p) < sz)
+							break;
+						p += sz;
+						continue;
+					}
+
+					size_t csz = CPlyHeader::size(prop.countType);
+					if ((size_t)(end - p) < csz)
+						break;
+					size_t n = (size_t)CPlyHeader::value(p, prop.countType);
+					if ((size_t)(end - p - csz) / sz < n)
+						break;
+					p += csz;
+					if (isFace && (prop.name == "vertex_indices" || prop.name == "vertex_index") && n >= 3)
+					{
+						uint32_t v0 = (uint32_t)CPlyHeader::value(p, prop.type);
+						uint32_t v1 = (uint32_t)CPlyHeader::value(p + sz, prop.type);
+						for (size_t k = 2; k < n; k++)
+						{
+							uint32_t v2 = (uint32_t)CPlyHeader::value(p + k * sz, prop.type);
+							triangles.push_back(v0);
+							triangles.push_back(v1);
+							triangles.push_back(v2);
+							v1 = v2;
+						}
+					}
+					p += n * sz;
+				}
+				if (j < props.size())
+				{
+					fprintf(stderr, "Error: %s is truncated\n", input);
+					triangles.clear();
+					return false;
+				}
+			}
+		}
+
+		for (size_t i = 0; i < triangles.size(); i++)
+		{
+			if (triangles[i] >= positions.size() / 3)
+			{
+				fprintf(stderr, "Error: %s has a face with an invalid vertex index\n", input);
+				triangles.clear();
+				return false;
+			}
+		}
+		return true;
+	};
+
+} // name space MeshLib
+
+#endif //_MESHLIB_BINARY_MESH_H_ defined
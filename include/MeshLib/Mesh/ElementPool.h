@@ -0,0 +1,305 @@
+/*!
+ *      \file ElementPool.h
+ *      \brief Chunked element storage and lookup indices used by CBaseMesh
+ *
+ */
+
+#ifndef _MESHLIB_ELEMENT_POOL_H_
+#define _MESHLIB_ELEMENT_POOL_H_
+
+#include <assert.h>
+#include <stddef.h>
+#include <new>
+#include <vector>
+#include <map>
+
+namespace MeshLib
+{
+
+	/*!
+	 * \brief CElementPool, chunked contiguous storage for mesh elements
+	 *
+	 *  Elements are constructed in place inside fixed size chunks, so a pointer stays valid
+	 *  until the element is released, and consecutively created elements are adjacent in
+	 *  memory. Released slots are reused by later allocations.
+	 *
+	 * \tparam T element type
+	 */
+	template <typename T>
+	class CElementPool
+	{
+	public:
+		/*! CElementPool constructor */
+		CElementPool() : m_used(kChunkSize) {};
+		/*! CElementPool destructor, frees the chunks. Live elements must be released before. */
+		~CElementPool()
+		{
+			for (size_t i = 0; i < m_chunks.size(); i++)
+				::operator delete(m_chunks[i]);
+		};
+
+		/*! Construct a new element */
+		T *allocate()
+		{
+			T *p;
+			if (!m_free.empty())
+			{
+				p = m_free.back();
+				m_free.pop_back();
+			}
+			else
+			{
+				if (m_used == kChunkSize)
+				{
+					m_chunks.push_back(static_cast<T *>(::operator new(sizeof(T) * kChunkSize)));
+					m_used = 0;
+				}
+				p = m_chunks.back() + m_used++;
+			}
+			return new (p) T();
+		};
+
+		/*! Destroy an element allocated by this pool, its slot is reused later */
+		void release(T *p)
+		{
+			assert(p != NULL);
+			p->~T();
+			m_free.push_back(p);
+		};
+
+	private:
+		CElementPool(const CElementPool &);
+		CElementPool &operator=(const CElementPool &);
+
+		/*! number of elements per chunk */
+		enum { kChunkSize = 4096 };
+		/*! allocated chunks, only the last one may have unused slots */
+		std::vector<T *> m_chunks;
+		/*! used slots in the last chunk */
+		size_t m_used;
+		/*! released slots */
+		std::vector<T *> m_free;
+	};
+
+	/*!
+	 * \brief CIdIndex, id to element lookup
+	 *
+	 *  Ids close to the number of stored elements (the usual 1..n numbering) are kept in a
+	 *  dense vector, so a lookup is a single array access. Negative or far out of range ids
+	 *  fall back to a map.
+	 *
+	 * \tparam T element type
+	 */
+	template <typename T>
+	class CIdIndex
+	{
+	public:
+		/*! CIdIndex constructor */
+		CIdIndex() : m_count(0) {};
+
+		/*! The element with the given id, NULL if there is none */
+		T *find(int id) const
+		{
+			if (id >= 0 && (size_t)id < m_dense.size() && m_dense[id] != NULL)
+				return m_dense[id];
+			if (m_sparse.empty())
+				return NULL;
+			typename std::map<int, T *>::const_iterator iter = m_sparse.find(id);
+			return iter == m_sparse.end() ? NULL : iter->second;
+		};
+
+		/*! Register an element; an id already in use keeps its first element */
+		void insert(int id, T *p)
+		{
+			if (find(id) != NULL)
+				return;
+			if (id >= 0 && (size_t)id < 2 * m_count + 1024)
+			{
+				if ((size_t)id >= m_dense.size())
+					m_dense.resize(id + 1 + id / 2, NULL);
+				m_dense[id] = p;
+			}
+			else
+			{
+				m_sparse[id] = p;
+			}
+			m_count++;
+		};
+
+		/*! Unregister the element with the given id */
+		void erase(int id)
+		{
+			if (id >= 0 && (size_t)id < m_dense.size() && m_dense[id] != NULL)
+			{
+				m_dense[id] = NULL;
+				m_count--;
+				return;
+			}
+			m_count -= m_sparse.erase(id);
+		};
+
+		/*! Remove all the entries */
+		void clear()
+		{
+			m_dense.clear();
+			m_sparse.clear();
+			m_count = 0;
+		};
+
+	private:
+		/*! elements indexed by id */
+		std::vector<T *> m_dense;
+		/*! elements whose id does not fit the dense vector */
+		std::map<int, T *> m_sparse;
+		/*! number of registered elements */
+		size_t m_count;
+	};
+
+	/*!
+	 * \brief CKeyIndex, hash table from 64 bit keys to values
+	 *
+	 *  Open addressing with linear probing. The all-ones key marks empty slots and can not
+	 *  be stored. Erased entries are closed by shifting the following entries back, so
+	 *  lookups never walk over tombstones.
+	 *
+	 * \tparam TValue value type
+	 */
+	template <typename TValue>
+	class CKeyIndex
+	{
+	public:
+		/*! CKeyIndex constructor */
+		CKeyIndex() : m_count(0), m_mask(0) {};
+
+		/*! The value stored under key, NULL if there is none */
+		TValue *find(unsigned long long key)
+		{
+			if (m_count == 0)
+				return NULL;
+			for (size_t i = _hash(key) & m_mask;; i = (i + 1) & m_mask)
+			{
+				if (m_keys[i] == key)
+					return &m_values[i];
+				if (m_keys[i] == kEmptyKey)
+					return NULL;
+			}
+		};
+
+		/*! The value stored under key, value-initialized if the key was absent */
+		TValue &operator[](unsigned long long key)
+		{
+			assert(key != kEmptyKey);
+			if (2 * (m_count + 1) > m_keys.size())
+				_rehash(m_keys.empty() ? 16 : 2 * m_keys.size());
+			size_t i = _hash(key) & m_mask;
+			while (m_keys[i] != key)
+			{
+				if (m_keys[i] == kEmptyKey)
+				{
+					m_keys[i] = key;
+					m_values[i] = TValue();
+					m_count++;
+					break;
+				}
+				i = (i + 1) & m_mask;
+			}
+			return m_values[i];
+		};
+
+		/*! Remove the entry stored under key */
+		void erase(unsigned long long key)
+		{
+			if (m_count == 0)
+				return;
+			size_t i = _hash(key) & m_mask;
+			while (m_keys[i] != key)
+			{
+				if (m_keys[i] == kEmptyKey)
+					return;
+				i = (i + 1) & m_mask;
+			}
+			m_keys[i] = kEmptyKey;
+			m_count--;
+			// shift back the entries whose probe sequence passed the freed slot
+			for (size_t j = (i + 1) & m_mask; m_keys[j] != kEmptyKey; j = (j + 1) & m_mask)
+			{
+				size_t k = _hash(m_keys[j]) & m_mask;
+				bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+				if (stays)
+					continue;
+				m_keys[i] = m_keys[j];
+				m_values[i] = m_values[j];
+				m_keys[j] = kEmptyKey;
+				i = j;
+			}
+		};
+
+		/*! Make room for n entries without rehashing */
+		void reserve(size_t n)
+		{
+			size_t capacity = 16;
+			while (capacity < 2 * n)
+				capacity <<= 1;
+			if (capacity > m_keys.size())
+				_rehash(capacity);
+		};
+
+		/*! Remove all the entries and free the table */
+		void clear()
+		{
+			std::vector<unsigned long long>().swap(m_keys);
+			std::vector<TValue>().swap(m_values);
+			m_count = 0;
+			m_mask = 0;
+		};
+
+		/*! Number of entries */
+		size_t size() const { return m_count; };
+
+	private:
+		static const unsigned long long kEmptyKey = ~0ULL;
+
+		static size_t _hash(unsigned long long key)
+		{
+			key ^= key >> 33;
+			key *= 0xff51afd7ed558ccdULL;
+			key ^= key >> 33;
+			return (size_t)key;
+		};
+
+		void _rehash(size_t capacity)
+		{
+			std::vector<unsigned long long> keys(capacity, kEmptyKey);
+			std::vector<TValue> values(capacity);
+			size_t mask = capacity - 1;
+			for (size_t i = 0; i < m_keys.size(); i++)
+			{
+				if (m_keys[i] == kEmptyKey)
+					continue;
+				size_t j = _hash(m_keys[i]) & mask;
+				while (keys[j] != kEmptyKey)
+					j = (j + 1) & mask;
+				keys[j] = m_keys[i];
+				values[j] = m_values[i];
+			}
+			m_keys.swap(keys);
+			m_values.swap(values);
+			m_mask = mask;
+		};
+
+		/*! slot keys, kEmptyKey marks an empty slot */
+		std::vector<unsigned long long> m_keys;
+		/*! slot values, valid where the key is not kEmptyKey */
+		std::vector<TValue> m_values;
+		/*! number of entries */
+		size_t m_count;
+		/*! slot count minus one */
+		size_t m_mask;
+	};
+
+	template <typename TValue>
+	const unsigned long long CKeyIndex<TValue>::kEmptyKey;
+
+} // name space MeshLib
+
+#endif //_MESHLIB_ELEMENT_POOL_H_ defined
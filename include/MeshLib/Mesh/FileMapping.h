@@ -0,0 +1,125 @@
+/*!
+ *      \file FileMapping.h
+ *      \brief Read-only memory mapped input files
+ *
+ */
+
+#ifndef _MESHLIB_FILE_MAPPING_H_
+#define _MESHLIB_FILE_MAPPING_H_
+
+#include <stddef.h>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace MeshLib
+{
+
+	/*!
+	 * \brief CFileMapping, a whole file mapped read-only into memory
+	 *
+	 *  The pages are loaded by the OS on first access, so parsing reads the file
+	 *  without copying it through stream buffers. An empty file maps to no data.
+	 */
+	class CFileMapping
+	{
+	public:
+		/*!
+		CFileMapping constructor
+		\param filename the input file name
+		*/
+		CFileMapping(const char *filename) : m_data(NULL), m_size(0), m_fail(true)
+		{
+#ifdef _WIN32
+			m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+			m_mapping = NULL;
+			if (m_file == INVALID_HANDLE_VALUE)
+				return;
+			LARGE_INTEGER size;
+			if (!GetFileSizeEx(m_file, &size))
+				return;
+			m_size = (size_t)size.QuadPart;
+			if (m_size > 0)
+			{
+				m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+				if (m_mapping == NULL)
+					return;
+				m_data = (const char *)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+				if (m_data == NULL)
+					return;
+			}
+#else
+			m_fd = open(filename, O_RDONLY);
+			if (m_fd < 0)
+				return;
+			struct stat st;
+			if (fstat(m_fd, &st) != 0)
+				return;
+			m_size = (size_t)st.st_size;
+			if (m_size > 0)
+			{
+				void *p = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, m_fd, 0);
+				if (p == MAP_FAILED)
+					return;
+				madvise(p, m_size, MADV_SEQUENTIAL);
+				m_data = (const char *)p;
+			}
+#endif
+			m_fail = false;
+		};
+
+		/*! CFileMapping destructor, unmaps the file */
+		~CFileMapping()
+		{
+#ifdef _WIN32
+			if (m_data != NULL)
+				UnmapViewOfFile(m_data);
+			if (m_mapping != NULL)
+				CloseHandle(m_mapping);
+			if (m_file != INVALID_HANDLE_VALUE)
+				CloseHandle(m_file);
+#else
+			if (m_data != NULL)
+				munmap((void *)m_data, m_size);
+			if (m_fd >= 0)
+				close(m_fd);
+#endif
+		};
+
+		/*! whether the file could not be opened or mapped */
+		bool fail() const { return m_fail; };
+		/*! first byte of the file */
+		const char *data() const { return m_data; };
+		/*! file size in bytes */
+		size_t size() const { return m_size; };
+
+	private:
+		CFileMapping(const CFileMapping &);
+		CFileMapping &operator=(const CFileMapping &);
+
+#ifdef _WIN32
+		HANDLE m_file;
+		HANDLE m_mapping;
+#else
+		int m_fd;
+#endif
+		const char *m_data;
+		size_t m_size;
+		bool m_fail;
+	};
+
+} // name space MeshLib
+
+#endif //_MESHLIB_FILE_MAPPING_H_ defined
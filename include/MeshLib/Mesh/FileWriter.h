@@ -0,0 +1,400 @@
+/*!
+ *      \file FileWriter.h
+ *      \brief Buffered file output used by the mesh writers
+ *
+ */
+
+#ifndef _MESHLIB_FILE_WRITER_H_
+#define _MESHLIB_FILE_WRITER_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+namespace MeshLib
+{
+
+	/*!
+	 * \brief CFileWriter, buffered output stream for mesh files
+	 *
+	 *  Collects the output in a large buffer and hands it to the file in big blocks,
+	 *  without flushing per line. Integers are formatted by hand, doubles with the
+	 *  shortest decimal representation that reads back to the same value.
+	 */
+	class CFileWriter
+	{
+	public:
+		/*!
+		CFileWriter constructor
+		\param filename the output file name
+		\param binary open in binary mode, otherwise line ends follow the platform
+		*/
+		CFileWriter(const char *filename, bool binary = false) : m_size(0)
+		{
+			m_fp = fopen(filename, binary ? "wb" : "w");
+			if (m_fp != NULL)
+				m_buffer.resize(kBufferSize);
+		};
+		/*! CFileWriter destructor, writes out the buffer and closes the file */
+		~CFileWriter() { close(); };
+
+		/*! whether the file could not be opened */
+		bool fail() const { return m_fp == NULL; };
+
+		/*! write out the buffer and close the file */
+		void close()
+		{
+			if (m_fp == NULL)
+				return;
+			flush();
+			fclose(m_fp);
+			m_fp = NULL;
+		};
+
+		/*! write out the buffer */
+		void flush()
+		{
+			if (m_size > 0)
+				fwrite(&m_buffer[0], 1, m_size, m_fp);
+			m_size = 0;
+		};
+
+		/*! append raw bytes */
+		void write(const void *data, size_t n)
+		{
+			if (m_size + n > m_buffer.size())
+			{
+				flush();
+				if (n > m_buffer.size())
+				{
+					fwrite(data, 1, n, m_fp);
+					return;
+				}
+			}
+			memcpy(&m_buffer[m_size], data, n);
+			m_size += n;
+		};
+
+		CFileWriter &operator<<(char c)
+		{
+			if (m_size == m_buffer.size())
+				flush();
+			m_buffer[m_size++] = c;
+			return *this;
+		};
+		CFileWriter &operator<<(const char *s)
+		{
+			write(s, strlen(s));
+			return *this;
+		};
+		CFileWriter &operator<<(const std::string &s)
+		{
+			write(s.data(), s.size());
+			return *this;
+		};
+		CFileWriter &operator<<(int v) { return _put_signed(v); };
+		CFileWriter &operator<<(long v) { return _put_signed(v); };
+		CFileWriter &operator<<(long long v) { return _put_signed(v); };
+		CFileWriter &operator<<(unsigned int v) { return _put_unsigned(v); };
+		CFileWriter &operator<<(unsigned long v) { return _put_unsigned(v); };
+		CFileWriter &operator<<(unsigned long long v) { return _put_unsigned(v); };
+		CFileWriter &operator<<(double v)
+		{
+			char buf[32];
+			write(buf, format_double(v, buf));
+			return *this;
+		};
+
+		/*!
+		Shortest decimal text that reads back to the same double (Grisu2), in %g
+		style: fixed notation for decimal exponents in [-4, 15), scientific otherwise.
+		\param v the value
+		\param buf at least 32 characters
+		\return number of characters written, without a terminating zero
+		*/
+		static size_t format_double(double v, char *buf)
+		{
+			// integral values are common (zero normals, flags) and need no digit search
+			if (v > -1e15 && v < 1e15 && v == (double)(long long)v && (v != 0 || 1 / v > 0))
+				return _format_unsigned(v < 0 ? (unsigned long long)-(long long)v : (unsigned long long)v, buf, v < 0);
+			if (v != v || v - v != 0 || v == 0) // nan, inf, -0
+				return (size_t)snprintf(buf, 32, "%g", v);
+
+			size_t k = 0;
+			if (v < 0)
+			{
+				buf[k++] = '-';
+				v = -v;
+			}
+			char digits[20];
+			int len, K;
+			_grisu2(v, digits, &len, &K);
+
+			// the value is digits * 10^K, its leading digit has decimal exponent e10
+			int e10 = len + K - 1;
+			if (e10 >= -4 && e10 < 15)
+			{
+				if (K >= 0)
+				{
+					memcpy(buf + k, digits, len);
+					k += len;
+					for (int i = 0; i < K; i++)
+						buf[k++] = '0';
+				}
+				else if (e10 >= 0)
+				{
+					memcpy(buf + k, digits, e10 + 1);
+					k += e10 + 1;
+					buf[k++] = '.';
+					memcpy(buf + k, digits + e10 + 1, len - e10 - 1);
+					k += len - e10 - 1;
+				}
+				else
+				{
+					buf[k++] = '0';
+					buf[k++] = '.';
+					for (int i = -1; i > e10; i--)
+						buf[k++] = '0';
+					memcpy(buf + k, digits, len);
+					k += len;
+				}
+				return k;
+			}
+
+			buf[k++] = digits[0];
+			if (len > 1)
+			{
+				buf[k++] = '.';
+				memcpy(buf + k, digits + 1, len - 1);
+				k += len - 1;
+			}
+			buf[k++] = 'e';
+			buf[k++] = e10 < 0 ? '-' : '+';
+			unsigned int ae = e10 < 0 ? -e10 : e10;
+			if (ae < 10)
+				buf[k++] = '0';
+			k += _format_unsigned(ae, buf + k, false);
+			return k;
+		};
+
+	private:
+		// Grisu2 (Loitsch, "Printing Floating-Point Numbers Quickly and Accurately
+		// with Integers"): the digits of v between its rounding boundaries are generated
+		// with 64 bit integer arithmetic on a cached power of ten.
+
+		/*! unnormalized floating point number f * 2^e */
+		struct DiyFp
+		{
+			DiyFp() : f(0), e(0) {};
+			DiyFp(unsigned long long f_, int e_) : f(f_), e(e_) {};
+
+			DiyFp operator-(const DiyFp &rhs) const { return DiyFp(f - rhs.f, e); };
+			DiyFp operator*(const DiyFp &rhs) const
+			{
+				const unsigned long long M32 = 0xFFFFFFFFULL;
+				unsigned long long a = f >> 32, b = f & M32, c = rhs.f >> 32, d = rhs.f & M32;
+				unsigned long long ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+				unsigned long long tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+				tmp += 1ULL << 31; // round
+				return DiyFp(ac + (ad >> 32) + (bc >> 32) + (tmp >> 32), e + rhs.e + 64);
+			};
+			DiyFp normalize() const
+			{
+				DiyFp r = *this;
+				while (!(r.f & (1ULL << 63)))
+				{
+					r.f <<= 1;
+					r.e--;
+				}
+				return r;
+			};
+
+			unsigned long long f;
+			int e;
+		};
+
+		static void _grisu2(double value, char *buffer, int *length, int *K)
+		{
+			const unsigned long long kHiddenBit = 1ULL << 52;
+			unsigned long long bits;
+			memcpy(&bits, &value, sizeof(bits));
+			int biased = (int)((bits >> 52) & 0x7FF);
+			unsigned long long significand = bits & (kHiddenBit - 1);
+			DiyFp v = biased != 0 ? DiyFp(significand + kHiddenBit, biased - 1075) : DiyFp(significand, -1074);
+
+			// boundaries m- and m+ halfway to the neighbouring doubles, on m+'s exponent
+			DiyFp plus((v.f << 1) + 1, v.e - 1);
+			while (!(plus.f & (kHiddenBit << 1)))
+			{
+				plus.f <<= 1;
+				plus.e--;
+			}
+			plus.f <<= 10;
+			plus.e -= 10;
+			DiyFp minus = (v.f == kHiddenBit) ? DiyFp((v.f << 2) - 1, v.e - 2) : DiyFp((v.f << 1) - 1, v.e - 1);
+			minus.f <<= minus.e - plus.e;
+			minus.e = plus.e;
+
+			const DiyFp c_mk = _cached_power(plus.e, K);
+			const DiyFp W = v.normalize() * c_mk;
+			DiyFp Wp = plus * c_mk;
+			DiyFp Wm = minus * c_mk;
+			Wm.f++;
+			Wp.f--;
+			_digit_gen(W, Wp, Wp.f - Wm.f, buffer, length, K);
+		};
+
+		/*! 10^-K with a binary exponent that puts e + its exponent into [-60, -32] */
+		static DiyFp _cached_power(int e, int *K)
+		{
+			static const unsigned long long kCachedPowers_F[] = {
+				0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+				0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+				0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+				0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+				0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+				0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+				0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+				0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+				0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+				0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+				0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+				0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+				0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+				0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+				0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+				0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+				0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+				0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+				0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+				0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+				0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+				0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL};
+			static const short kCachedPowers_E[] = {
+				-1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980, -954, -927,
+				-901, -874, -847, -821, -794, -768, -741, -715, -688, -661, -635, -608,
+				-582, -555, -529, -502, -475, -449, -422, -396, -369, -343, -316, -289,
+				-263, -236, -210, -183, -157, -130, -103, -77, -50, -24, 3, 30,
+				56, 83, 109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+				375, 402, 428, 455, 481, 508, 534, 561, 588, 614, 641, 667,
+				694, 720, 747, 774, 800, 827, 853, 880, 907, 933, 960, 986,
+				1013, 1039, 1066};
+			double dk = (-61 - e) * 0.30102999566398114 + 347;
+			int k = (int)dk;
+			if (dk - k > 0.0)
+				k++;
+			unsigned int index = (unsigned int)((k >> 3) + 1);
+			*K = -(-348 + (int)(index << 3));
+			return DiyFp(kCachedPowers_F[index], kCachedPowers_E[index]);
+		};
+
+		static void _grisu_round(char *buffer, int len, unsigned long long delta, unsigned long long rest, unsigned long long ten_kappa, unsigned long long wp_w)
+		{
+			while (rest < wp_w && delta - rest >= ten_kappa &&
+				   (rest + ten_kappa < wp_w || wp_w - rest > rest + ten_kappa - wp_w))
+			{
+				buffer[len - 1]--;
+				rest += ten_kappa;
+			}
+		};
+
+		static void _digit_gen(const DiyFp &W, const DiyFp &Mp, unsigned long long delta, char *buffer, int *len, int *K)
+		{
+			static const unsigned long long kPow10[] = {
+				1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL,
+				1000000000ULL, 10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+				100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+				1000000000000000000ULL, 10000000000000000000ULL};
+			const DiyFp one(1ULL << -Mp.e, Mp.e);
+			const DiyFp wp_w = Mp - W;
+			unsigned int p1 = (unsigned int)(Mp.f >> -one.e);
+			unsigned long long p2 = Mp.f & (one.f - 1);
+			int kappa = 1;
+			while (kappa < 10 && p1 >= kPow10[kappa])
+				kappa++;
+			*len = 0;
+
+			while (kappa > 0)
+			{
+				unsigned int d = (unsigned int)(p1 / kPow10[kappa - 1]);
+				p1 = (unsigned int)(p1 % kPow10[kappa - 1]);
+				if (d || *len)
+					buffer[(*len)++] = (char)('0' + d);
+				kappa--;
+				unsigned long long tmp = ((unsigned long long)p1 << -one.e) + p2;
+				if (tmp <= delta)
+				{
+					*K += kappa;
+					_grisu_round(buffer, *len, delta, tmp, kPow10[kappa] << -one.e, wp_w.f);
+					return;
+				}
+			}
+
+			for (;;)
+			{
+				p2 *= 10;
+				delta *= 10;
+				char d = (char)(p2 >> -one.e);
+				if (d || *len)
+					buffer[(*len)++] = (char)('0' + d);
+				p2 &= one.f - 1;
+				kappa--;
+				if (p2 < delta)
+				{
+					*K += kappa;
+					int index = -kappa;
+					_grisu_round(buffer, *len, delta, p2, one.f, wp_w.f * (index < 20 ? kPow10[index] : 0));
+					return;
+				}
+			}
+		};
+
+		CFileWriter(const CFileWriter &);
+		CFileWriter &operator=(const CFileWriter &);
+
+		template <typename T>
+		CFileWriter &_put_signed(T v)
+		{
+			char buf[24];
+			unsigned long long u = v < 0 ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+			write(buf, _format_unsigned(u, buf, v < 0));
+			return *this;
+		};
+
+		template <typename T>
+		CFileWriter &_put_unsigned(T v)
+		{
+			char buf[24];
+			write(buf, _format_unsigned((unsigned long long)v, buf, false));
+			return *this;
+		};
+
+		static size_t _format_unsigned(unsigned long long u, char *buf, bool negative)
+		{
+			char tmp[24];
+			size_t n = 0;
+			do
+			{
+				tmp[n++] = (char)('0' + u % 10);
+				u /= 10;
+			} while (u != 0);
+			size_t k = 0;
+			if (negative)
+				buf[k++] = '-';
+			while (n > 0)
+				buf[k++] = tmp[--n];
+			return k;
+		};
+
+		/*! buffer size in bytes */
+		enum { kBufferSize = 1 << 20 };
+		FILE *m_fp;
+		std::vector<char> m_buffer;
+		size_t m_size;
+	};
+
+} // name space MeshLib
+
+#endif //_MESHLIB_FILE_WRITER_H_ defined
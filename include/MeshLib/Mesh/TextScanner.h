@@ -0,0 +1,423 @@
+/*!
+ *      \file TextScanner.h
+ *      \brief Allocation free scanning of memory mapped text files
+ *
+ */
+
+#ifndef _MESHLIB_TEXT_SCANNER_H_
+#define _MESHLIB_TEXT_SCANNER_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <thread>
+
+namespace MeshLib
+{
+
+	/*!
+	 * \brief CTextRange, a piece of text inside a mapped file
+	 */
+	struct CTextRange
+	{
+		CTextRange() : s(NULL), n(0) {};
+		CTextRange(const char *s_, size_t n_) : s(s_), n(n_) {};
+
+		/*! the text as a string */
+		std::string str() const { return std::string(s, n); };
+
+		const char *s;
+		size_t n;
+	};
+
+	/*!
+	 * \brief CTextScanner, reads words and numbers line by line from a text buffer
+	 *
+	 *  Nothing is copied or allocated: words are returned as ranges into the buffer and
+	 *  numbers are converted in place. Lines end at '\n'; '\r' counts as a blank.
+	 */
+	class CTextScanner
+	{
+	public:
+		/*!
+		CTextScanner constructor
+		\param begin first character
+		\param end one past the last character
+		*/
+		CTextScanner(const char *begin, const char *end) : m_p(begin), m_end(end) {};
+
+		/*! whether the whole buffer has been read */
+		bool eof() const { return m_p >= m_end; };
+
+		/*! move to the first character of the next line */
+		void next_line()
+		{
+			const char *p = (const char *)memchr(m_p, '\n', m_end - m_p);
+			m_p = p == NULL ? m_end : p + 1;
+		};
+
+		/*! whether only blanks are left on the current line */
+		bool eol()
+		{
+			_skip_blanks();
+			return m_p >= m_end || *m_p == '\n';
+		};
+
+		/*! the next word on the current line, false at the end of the line */
+		bool word(CTextRange &w)
+		{
+			if (eol())
+				return false;
+			const char *s = m_p;
+			while (m_p < m_end && !_is_space(*m_p))
+				m_p++;
+			w = CTextRange(s, m_p - s);
+			return true;
+		};
+
+		/*! the next character on the current line, 0 at the end of the line */
+		char peek()
+		{
+			return eol() ? 0 : *m_p;
+		};
+
+		/*! consume the character c if it comes next, without skipping blanks */
+		bool skip(char c)
+		{
+			if (m_p < m_end && *m_p == c)
+			{
+				m_p++;
+				return true;
+			}
+			return false;
+		};
+
+		/*! the rest of the current line, without the line end */
+		CTextRange rest()
+		{
+			_skip_blanks();
+			const char *s = m_p;
+			const char *p = (const char *)memchr(m_p, '\n', m_end - m_p);
+			m_p = p == NULL ? m_end : p;
+			const char *e = m_p;
+			while (e > s && _is_space(e[-1]))
+				e--;
+			return CTextRange(s, e - s);
+		};
+
+		/*! parse a decimal integer; false if the next word does not start with one */
+		bool parse_int(int &v)
+		{
+			_skip_blanks();
+			const char *p = m_p;
+			bool negative = false;
+			if (p < m_end && (*p == '-' || *p == '+'))
+				negative = *p++ == '-';
+			if (p >= m_end || !_is_digit(*p))
+				return false;
+			long long u = 0;
+			while (p < m_end && _is_digit(*p))
+				u = u * 10 + (*p++ - '0');
+			v = (int)(negative ? -u : u);
+			m_p = p;
+			return true;
+		};
+
+		/*!
+		parse a floating point number. Plain decimals with up to 19 significant digits and
+		moderate exponents, i.e. almost all, are converted exactly in place; anything else
+		goes through strtod.
+		*/
+		bool parse_double(double &v)
+		{
+			CTextRange w;
+			const char *start = m_p;
+			if (!word(w))
+				return false;
+
+			const char *p = w.s, *e = w.s + w.n;
+			bool negative = false;
+			if (p < e && (*p == '-' || *p == '+'))
+				negative = *p++ == '-';
+			unsigned long long m = 0;
+			int digits = 0, exp10 = 0;
+			bool any = false, truncated = false;
+			for (; p < e && _is_digit(*p); p++, any = true)
+			{
+				if (digits < 19)
+				{
+					m = m * 10 + (*p - '0');
+					if (m != 0)
+						digits++;
+				}
+				else
+				{
+					exp10++;
+					truncated = true;
+				}
+			}
+			if (p < e && *p == '.')
+			{
+				for (p++; p < e && _is_digit(*p); p++, any = true)
+				{
+					if (digits < 19)
+					{
+						m = m * 10 + (*p - '0');
+						if (m != 0)
+							digits++;
+						exp10--;
+					}
+					else
+						truncated = true;
+				}
+			}
+			if (any && p < e && (*p == 'e' || *p == 'E'))
+			{
+				const char *q = p + 1;
+				bool eneg = false;
+				if (q < e && (*q == '-' || *q == '+'))
+					eneg = *q++ == '-';
+				if (q < e && _is_digit(*q))
+				{
+					int x = 0;
+					for (; q < e && _is_digit(*q); q++)
+						x = x < 10000 ? x * 10 + (*q - '0') : x;
+					exp10 += eneg ? -x : x;
+					p = q;
+				}
+			}
+
+			if (any && p == e && !truncated)
+			{
+				// exact when the digits fit a double and 10^|exp10| is exact too
+				static const double kPow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+												1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+				double d;
+				if (m == 0)
+					d = 0;
+				else if (m <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22)
+					d = exp10 < 0 ? (double)m / kPow10[-exp10] : (double)m * kPow10[exp10];
+				else if (!_eisel_lemire(m, exp10, d))
+					d = -1;
+				if (d >= 0)
+				{
+					v = negative ? -d : d;
+					return true;
+				}
+			}
+
+			char buf[64];
+			std::string s;
+			const char *text = buf;
+			if (w.n < sizeof(buf))
+			{
+				memcpy(buf, w.s, w.n);
+				buf[w.n] = 0;
+			}
+			else
+			{
+				s = w.str();
+				text = s.c_str();
+			}
+			char *stop;
+			v = strtod(text, &stop);
+			if (stop == text)
+			{
+				m_p = start;
+				return false;
+			}
+			return true;
+		};
+
+		/*!
+		Split a buffer into line aligned pieces of about equal size
+		\param begin first character
+		\param end one past the last character
+		\param n number of pieces
+		\return n+1 boundaries, piece i is [b[i], b[i+1])
+		*/
+		static std::vector<const char *> split(const char *begin, const char *end, size_t n)
+		{
+			std::vector<const char *> b(n + 1, end);
+			b[0] = begin;
+			for (size_t i = 1; i < n; i++)
+			{
+				const char *p = begin + (end - begin) / n * i;
+				if (p < b[i - 1])
+					p = b[i - 1];
+				const char *q = (const char *)memchr(p, '\n', end - p);
+				b[i] = q == NULL ? end : q + 1;
+			}
+			return b;
+		};
+
+		/*!
+		Number of pieces to parse a buffer of the given size with: one per hardware thread,
+		but none smaller than a megabyte
+		*/
+		static size_t num_pieces(size_t size)
+		{
+			size_t n = std::thread::hardware_concurrency();
+			size_t m = size / (1 << 20) + 1;
+			return n == 0 ? 1 : (n < m ? n : m);
+		};
+
+		/*! Run fn(i) for i in [0, n), one thread per call */
+		template <typename TFunc>
+		static void parallel(size_t n, TFunc fn)
+		{
+			if (n <= 1)
+			{
+				if (n == 1)
+					fn((size_t)0);
+				return;
+			}
+			std::vector<std::thread> threads;
+			for (size_t i = 1; i < n; i++)
+				threads.push_back(std::thread(fn, i));
+			fn((size_t)0);
+			for (size_t i = 0; i < threads.size(); i++)
+				threads[i].join();
+		};
+
+	private:
+		static bool _is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; };
+		static bool _is_digit(char c) { return c >= '0' && c <= '9'; };
+
+		/*! 128 bit product of two 64 bit numbers */
+		static void _mul128(unsigned long long a, unsigned long long b, unsigned long long &hi, unsigned long long &lo)
+		{
+			const unsigned long long M32 = 0xFFFFFFFFULL;
+			unsigned long long a0 = a & M32, a1 = a >> 32, b0 = b & M32, b1 = b >> 32;
+			unsigned long long p00 = a0 * b0, p01 = a0 * b1, p10 = a1 * b0, p11 = a1 * b1;
+			unsigned long long mid = (p00 >> 32) + (p01 & M32) + (p10 & M32);
+			lo = (mid << 32) | (p00 & M32);
+			hi = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+		};
+
+		/*!
+		m * 10^q correctly rounded, for m != 0 (Eisel-Lemire: Lemire, "Number Parsing at a
+		Gigabyte per Second"). Covers 10^-64 .. 10^38 and normal results; false otherwise,
+		or when the 128 bit approximation cannot decide the rounding.
+		*/
+		static bool _eisel_lemire(unsigned long long m, int q, double &d)
+		{
+			// 5^q scaled to [2^127, 2^128), rounded up for q < 0
+			static const unsigned long long kPow5[] = {
+				0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL, 0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL,
+				0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL, 0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL,
+				0xcdb02555653131b6ULL, 0x3792f412cb06794dULL, 0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL,
+				0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL, 0xc8de047564d20a8bULL, 0xf245825a5a445275ULL,
+				0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL, 0x9ced737bb6c4183dULL, 0x55464dd69685606bULL,
+				0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL, 0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL,
+				0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL, 0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL,
+				0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL, 0x95a8637627989aadULL, 0xdde7001379a44aa8ULL,
+				0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL, 0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL,
+				0x9226712162ab070dULL, 0xcab3961304ca70e8ULL, 0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL,
+				0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL, 0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL,
+				0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL, 0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL,
+				0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL, 0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL,
+				0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL, 0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL,
+				0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL, 0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL,
+				0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL, 0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL,
+				0xcfb11ead453994baULL, 0x67de18eda5814af2ULL, 0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL,
+				0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL, 0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL,
+				0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL, 0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL,
+				0xc612062576589ddaULL, 0x95364afe032a819eULL, 0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL,
+				0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL, 0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL,
+				0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL, 0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL,
+				0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL, 0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL,
+				0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL, 0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL,
+				0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL, 0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL,
+				0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL, 0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL,
+				0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL, 0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL,
+				0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL, 0x89705f4136b4a597ULL, 0x31680a88f8953031ULL,
+				0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL, 0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL,
+				0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL, 0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL,
+				0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL, 0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL,
+				0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL, 0xccccccccccccccccULL, 0xcccccccccccccccdULL,
+				0x8000000000000000ULL, 0x0000000000000000ULL, 0xa000000000000000ULL, 0x0000000000000000ULL,
+				0xc800000000000000ULL, 0x0000000000000000ULL, 0xfa00000000000000ULL, 0x0000000000000000ULL,
+				0x9c40000000000000ULL, 0x0000000000000000ULL, 0xc350000000000000ULL, 0x0000000000000000ULL,
+				0xf424000000000000ULL, 0x0000000000000000ULL, 0x9896800000000000ULL, 0x0000000000000000ULL,
+				0xbebc200000000000ULL, 0x0000000000000000ULL, 0xee6b280000000000ULL, 0x0000000000000000ULL,
+				0x9502f90000000000ULL, 0x0000000000000000ULL, 0xba43b74000000000ULL, 0x0000000000000000ULL,
+				0xe8d4a51000000000ULL, 0x0000000000000000ULL, 0x9184e72a00000000ULL, 0x0000000000000000ULL,
+				0xb5e620f480000000ULL, 0x0000000000000000ULL, 0xe35fa931a0000000ULL, 0x0000000000000000ULL,
+				0x8e1bc9bf04000000ULL, 0x0000000000000000ULL, 0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL,
+				0xde0b6b3a76400000ULL, 0x0000000000000000ULL, 0x8ac7230489e80000ULL, 0x0000000000000000ULL,
+				0xad78ebc5ac620000ULL, 0x0000000000000000ULL, 0xd8d726b7177a8000ULL, 0x0000000000000000ULL,
+				0x878678326eac9000ULL, 0x0000000000000000ULL, 0xa968163f0a57b400ULL, 0x0000000000000000ULL,
+				0xd3c21bcecceda100ULL, 0x0000000000000000ULL, 0x84595161401484a0ULL, 0x0000000000000000ULL,
+				0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL, 0xcecb8f27f4200f3aULL, 0x0000000000000000ULL,
+				0x813f3978f8940984ULL, 0x4000000000000000ULL, 0xa18f07d736b90be5ULL, 0x5000000000000000ULL,
+				0xc9f2c9cd04674edeULL, 0xa400000000000000ULL, 0xfc6f7c4045812296ULL, 0x4d00000000000000ULL,
+				0x9dc5ada82b70b59dULL, 0xf020000000000000ULL, 0xc5371912364ce305ULL, 0x6c28000000000000ULL,
+				0xf684df56c3e01bc6ULL, 0xc732000000000000ULL, 0x9a130b963a6c115cULL, 0x3c7f400000000000ULL,
+				0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL, 0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL,
+				0x96769950b50d88f4ULL, 0x1314448000000000ULL,
+			};
+			const int kMinQ = -64, kMaxQ = 38;
+			if (q < kMinQ || q > kMaxQ)
+				return false;
+			const unsigned long long *t = kPow5 + 2 * (q - kMinQ);
+
+			int lz = 0;
+			while (!(m & (1ULL << 63)))
+			{
+				m <<= 1;
+				lz++;
+			}
+			unsigned long long hi, lo;
+			_mul128(m, t[0], hi, lo);
+			if ((hi & 0x1FF) == 0x1FF)
+			{
+				unsigned long long hi2, lo2;
+				_mul128(m, t[1], hi2, lo2);
+				lo += hi2;
+				if (hi2 > lo)
+					hi++;
+				if ((hi & 0x1FF) == 0x1FF && lo == ~0ULL && (q < -27 || q > 55))
+					return false;
+			}
+
+			int upper = (int)(hi >> 63);
+			int shift = upper + 9;
+			unsigned long long mantissa = hi >> shift;
+			int power2 = (((152170 + 65536) * q) >> 16) + 63 + upper - lz + 1023;
+			if (power2 <= 0)
+				return false;
+			// exactly halfway between two doubles: round to even
+			if (lo <= 1 && q >= -4 && q <= 23 && (mantissa & 3) == 1 && (mantissa << shift) == hi)
+				mantissa &= ~1ULL;
+			mantissa += mantissa & 1;
+			mantissa >>= 1;
+			if (mantissa >= (2ULL << 52))
+			{
+				mantissa = 1ULL << 52;
+				power2++;
+			}
+			mantissa &= ~(1ULL << 52);
+			if (power2 >= 0x7FF)
+				return false;
+
+			unsigned long long bits = mantissa | ((unsigned long long)power2 << 52);
+			memcpy(&d, &bits, sizeof(d));
+			return true;
+		};
+
+		/*! skip blanks, but not the line end */
+		void _skip_blanks()
+		{
+			while (m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\r'))
+				m_p++;
+		};
+
+		const char *m_p;
+		const char *m_end;
+	};
+
+} // name space MeshLib
+
+#endif //_MESHLIB_TEXT_SCANNER_H_ defined
@@ -778,12 +778,12 @@ public:
 	MeshVertexIterator( CBaseMesh<CVertex,CEdge,CFace,CHalfEdge> * pMesh )
 	{
 		m_pMesh = pMesh;
-		m_iter = m_pMesh->vertices().begin();
+		m_iter = 0;
 	}
 	/*!
 	The vertex, pointed by the current iterator
 	*/
-	CVertex * value() { return *m_iter; };
+	CVertex * value() { return m_pMesh->vertex_array()[m_iter]; };
 	/*!
 	The vertex, pointed by the current iterator
 	*/
@@ -800,7 +800,7 @@ public:
 	/*!
 		Indicate whether all the vertices have been accessed.
 	*/
-	bool end() { return m_iter == m_pMesh->vertices().end(); }
+	bool end() { return m_iter >= m_pMesh->vertex_array().size(); }
 	
 private:
 	/*!
@@ -808,9 +808,9 @@ private:
 	*/
 	CBaseMesh<CVertex,CEdge,CFace,CHalfEdge> * m_pMesh;
 	/*! 
-	Current vertex list iterator.
+	Current vertex index.
 	*/
-	typename std::list<CVertex*>::iterator m_iter;
+	size_t m_iter;
 };
 
 // mesh->f
@@ -828,12 +828,12 @@ public:
 	MeshFaceIterator( CBaseMesh<CVertex,CEdge,CFace,CHalfEdge> * pMesh )
 	{
       m_pMesh = pMesh;
-      m_iter = pMesh->faces().begin();
+      m_iter = 0;
 	}
 	/*!
 	The face, pointed by the current iterator
 	*/
-	CFace * value() { return *m_iter; };
+	CFace * value() { return m_pMesh->face_array()[m_iter]; };
 	/*!
 	The face, pointed by the current iterator
 	*/
@@ -850,15 +850,15 @@ public:
 	/*!
 		Indicate whether all the faces have been accessed.
 	*/
-	bool end() { return m_iter == m_pMesh->faces().end(); }
+	bool end() { return m_iter >= m_pMesh->face_array().size(); }
 
 private:
 	/*! Current mesh.
 	*/
 	CBaseMesh<CVertex,CEdge,CFace,CHalfEdge> * m_pMesh;
-	/*! Current face list iterator.
+	/*! Current face index.
 	*/
-	typename std::list<CFace*>::iterator  m_iter;
+	size_t m_iter;
 };
 
 //Mesh->e
@@ -876,12 +876,12 @@ public:
 	MeshEdgeIterator( CBaseMesh<CVertex,CEdge,CFace,CHalfEdge> * pMesh )
 	{
 		m_pMesh = pMesh;
-		m_iter = m_pMesh->edges().begin();
+		m_iter = 0;
 	}
 	/*!
 	The edge, pointed by the current iterator
 	*/	
-	CEdge * value() { return *m_iter; };
+	CEdge * value() { return m_pMesh->edge_array()[m_iter]; };
 	/*!
 	The edge, pointed by the current iterator
 	*/	
@@ -897,7 +897,7 @@ public:
 	/*!
 		Indicate whether all the edges have been accessed.
 	*/	
-	bool end() { return m_iter == m_pMesh->edges().end(); }
+	bool end() { return m_iter >= m_pMesh->edge_array().size(); }
 
 
 private:
@@ -906,9 +906,9 @@ private:
 	*/
 	CBaseMesh<CVertex,CEdge,CFace,CHalfEdge> * m_pMesh;
 	/*!
-	current edge list iterator
+	current edge index
 	*/
-	typename std::list<CEdge*>::iterator m_iter;
+	size_t m_iter;
 };
 
 // Mesh->he
@@ -926,13 +926,13 @@ public:
 	MeshHalfEdgeIterator( CBaseMesh<CVertex,CEdge,CFace,CHalfEdge> * pMesh )
 	{
      m_pMesh = pMesh;
-     m_iter = m_pMesh->edges().begin();
+     m_iter = 0;
      m_id = 0;
 	}
 	/*!
 	The halfedge, pointed by the current iterator
 	*/	
-	CHalfEdge * value() { CEdge * e = *m_iter; return (CHalfEdge*)e->halfedge(m_id); };
+	CHalfEdge * value() { CEdge * e = m_pMesh->edge_array()[m_iter]; return (CHalfEdge*)e->halfedge(m_id); };
 	/*!
 	The halfedge, pointed by the current iterator
 	*/	
@@ -948,7 +948,7 @@ public:
 		{
 		case 1:
 			{
-				CEdge * e = *m_iter;
+				CEdge * e = m_pMesh->edge_array()[m_iter];
 				if( e->halfedge(m_id) == NULL )
 				{
 					m_id = 0;
@@ -973,7 +973,7 @@ public:
 		{
 		case 1:
 			{
-				CEdge * e = *m_iter;
+				CEdge * e = m_pMesh->edge_array()[m_iter];
 				if( e->halfedge(m_id) == NULL )
 				{
 					m_id = 0;
@@ -990,7 +990,7 @@ public:
 	/*!
 	Indicate whether all the halfedges have been accessed
 	*/
-	bool end() { return m_iter == m_pMesh->edges().end(); }
+	bool end() { return m_iter >= m_pMesh->edge_array().size(); }
 	
 
 private:
@@ -1003,9 +1003,9 @@ private:
 	*/
 	CBaseMesh<CVertex,CEdge,CFace,CHalfEdge> *	 m_pMesh;
 	/*!
-		Current edge list iterator
+		Current edge index
 	*/
-	typename std::list<CEdge*>::iterator m_iter;
+	size_t m_iter;
 	int  m_id;
 };
 
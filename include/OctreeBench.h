@@ -0,0 +1,162 @@
+#ifndef _OCTREE_BENCH_H_
+#define _OCTREE_BENCH_H_
+
+#include <vector>
+#include <chrono>
+#include <iostream>
+#include <algorithm>
+
+#include "OctreeSMC.h"
+
+namespace MeshLib
+{
+  using namespace std;
+
+  struct OSMCBenchRow
+  {
+    int depth;
+    int faces;
+    OSMCTiming inlined;
+    OSMCTiming erased;
+  };
+
+  // Run gen_mesh once and return its stage timings
+  template <typename S>
+  inline OSMCTiming bench_gen_mesh(S &smc, int &faces)
+  {
+    CTMesh *mesh = smc.gen_mesh();
+    faces = mesh->numFaces();
+    delete mesh;
+    return smc.timing();
+  }
+
+  // Compare the inlined field path (CFieldOctreeSMC<lambda>) with the
+  // std::function path (COctreeSMC) on the sphere scene.
+  inline void bench_field_paths(int minDepth, int maxDepth)
+  {
+    double radius = 1.0;
+    auto sphere = [radius](const CPoint &p)
+    {
+      return p[0] * p[0] + p[1] * p[1] + p[2] * p[2] - radius * radius;
+    };
+    CPoint bboxMin(-1.5, -1.5, -1.5);
+    CPoint bboxMax(1.5, 1.5, 1.5);
+
+    vector<OSMCBenchRow> rows;
+    for (int depth = minDepth; depth <= maxDepth; ++depth)
+    {
+      OSMCBenchRow row;
+      row.depth = depth;
+      int facesErased = 0;
+      {
+        CFieldOctreeSMC<decltype(sphere)> smc(sphere, 0.0, bboxMin, bboxMax, depth);
+        row.inlined = bench_gen_mesh(smc, row.faces);
+      }
+      {
+        COctreeSMC smc(sphere, 0.0, bboxMin, bboxMax, depth);
+        row.erased = bench_gen_mesh(smc, facesErased);
+      }
+      if (facesErased != row.faces)
+        cerr << "[Bench] face count mismatch at depth " << depth << endl;
+      rows.push_back(row);
+    }
+
+    // The construct stage is dominated by field sampling; extract also samples
+    // every boundary cell corner but is bounded by mesh construction.
+    cout << "[Bench] sphere gen_mesh (ms), inlined field vs std::function" << endl;
+    cout << "[Bench] depth\tfaces\tconstruct\t\textract\t\ttotal" << endl;
+    for (size_t i = 0; i < rows.size(); ++i)
+    {
+      const OSMCBenchRow &r = rows[i];
+      cout << "[Bench] " << r.depth << "\t" << r.faces
+           << "\t" << r.inlined.construct << " / " << r.erased.construct
+           << "\t" << r.inlined.extract << " / " << r.erased.extract
+           << "\t" << r.inlined.total << " / " << r.erased.total << endl;
+    }
+  }
+
+  // Corner gathers of the extraction walk: the sphere's boundary cells in
+  // Morton order each read their 8 corner values from a float grid, once in
+  // rows ((z * G + y) * G + x) and once in the bricks of osmc_brick_slot. At
+  // depths 8 and 9 the grid is far larger than the caches, so the time per
+  // cell is dominated by cache misses.
+  inline void bench_corner_layout(int minDepth, int maxDepth)
+  {
+    cout << "[Bench] corner gather per boundary cell (ns), row layout vs bricks" << endl;
+    cout << "[Bench] depth\tcells\trows\tbricks" << endl;
+    for (int depth = minDepth; depth <= maxDepth; ++depth)
+    {
+      int scale = 1 << depth;
+      int n = scale + 1;
+      int bricks = (n + kBrickSize - 1) >> kBrickBits;
+      double step = 3.0 / scale;
+      vector<float> rows(static_cast<size_t>(n) * n * n);
+      vector<float> bricked(static_cast<size_t>(bricks) * bricks * bricks << (3 * kBrickBits));
+      for (int gz = 0; gz < n; ++gz)
+      {
+        for (int gy = 0; gy < n; ++gy)
+        {
+          for (int gx = 0; gx < n; ++gx)
+          {
+            double x = -1.5 + gx * step, y = -1.5 + gy * step, z = -1.5 + gz * step;
+            float value = static_cast<float>(x * x + y * y + z * z - 1.0);
+            rows[(static_cast<size_t>(gz) * n + gy) * n + gx] = value;
+            bricked[osmc_brick_slot(gx, gy, gz, bricks)] = value;
+          }
+        }
+      }
+
+      vector<unsigned long long> cells;
+      for (int z = 0; z < scale; ++z)
+      {
+        for (int y = 0; y < scale; ++y)
+        {
+          for (int x = 0; x < scale; ++x)
+          {
+            bool inside = rows[(static_cast<size_t>(z) * n + y) * n + x] < 0;
+            for (int k = 1; k < 8; ++k)
+            {
+              size_t idx = (static_cast<size_t>(z + (k >> 2)) * n + y + ((k >> 1) & 1)) * n + x + (k & 1);
+              if ((rows[idx] < 0) != inside)
+              {
+                cells.push_back(osmc_morton_encode(x, y, z));
+                break;
+              }
+            }
+          }
+        }
+      }
+      std::sort(cells.begin(), cells.end());
+
+      // Best of three passes per layout
+      double sums[2] = {0, 0};
+      double ns[2] = {0, 0};
+      for (int pass = 0; pass < 6; ++pass)
+      {
+        int layout = pass & 1;
+        sums[layout] = 0;
+        auto t0 = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < cells.size(); ++i)
+        {
+          int x = static_cast<int>(osmc_compact_bits3(cells[i]));
+          int y = static_cast<int>(osmc_compact_bits3(cells[i] >> 1));
+          int z = static_cast<int>(osmc_compact_bits3(cells[i] >> 2));
+          for (int k = 0; k < 8; ++k)
+          {
+            int gx = x + (k & 1), gy = y + ((k >> 1) & 1), gz = z + (k >> 2);
+            sums[layout] += layout == 0 ? rows[(static_cast<size_t>(gz) * n + gy) * n + gx]
+                                        : bricked[osmc_brick_slot(gx, gy, gz, bricks)];
+          }
+        }
+        auto t1 = std::chrono::steady_clock::now();
+        double t = cells.empty() ? 0.0 : std::chrono::duration<double, std::nano>(t1 - t0).count() / cells.size();
+        if (pass < 2 || t < ns[layout])
+          ns[layout] = t;
+      }
+      if (sums[0] != sums[1])
+        cerr << "[Bench] corner sum mismatch at depth " << depth << endl;
+      cout << "[Bench] " << depth << "\t" << cells.size() << "\t" << ns[0] << "\t" << ns[1] << endl;
+    }
+  }
+}
+#endif
@@ -8,9 +8,20 @@
 #include <algorithm>
 #include <queue>
 #include <climits>
+#include <limits>
 #include <iostream>
 #include <chrono>
 #include <functional>
+#include <utility>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "ToolMesh.h"
 
@@ -33,6 +44,177 @@ namespace MeshLib
     int d;
   };
 
+  // Scalar field sample: f(p)
+  typedef std::function<double(const CPoint &)> OSMCScalarFunc;
+  // Batched field samples in SoA layout: values[i] = f(xs[i], ys[i], zs[i]) for i < count
+  typedef std::function<void(const double *xs, const double *ys, const double *zs, double *values, int count)> OSMCBatchFunc;
+  // Conservative range [fmin, fmax] of the field over an axis-aligned box
+  typedef std::function<void(const CPoint &boxMin, const CPoint &boxMax, double &fmin, double &fmax)> OSMCIntervalFunc;
+  // Field gradient at p (points from inside to outside)
+  typedef std::function<CPoint(const CPoint &)> OSMCGradientFunc;
+
+  // Depth limits: the dense corner grid holds (2^depth+1)^3 states, the sparse
+  // store only the bricks touched by the surface
+  static const int kMaxDenseDepth = 9;
+  static const int kMaxSparseDepth = 16;
+  // Corner states are stored in bricks of kBrickSize^3 grid points: hashed in
+  // sparse mode, a full brick grid in dense mode
+  static const int kBrickBits = 3;
+  static const int kBrickSize = 1 << kBrickBits;
+
+  // Index of a grid point inside its brick (z, y, x order)
+  static inline int osmc_brick_local(int gx, int gy, int gz)
+  {
+    return (((gz & (kBrickSize - 1)) << kBrickBits) + (gy & (kBrickSize - 1))) * kBrickSize + (gx & (kBrickSize - 1));
+  }
+
+  // Slot of a grid point in a dense grid of bricksPerAxis^3 bricks stored x
+  // fastest. A brick of state bits is 8 words (one cache line): word z, bit
+  // y * 8 + x, i.e. word slot >> 6, bit slot & 63.
+  static inline size_t osmc_brick_slot(int gx, int gy, int gz, int bricksPerAxis)
+  {
+    size_t brick = (static_cast<size_t>(gz >> kBrickBits) * bricksPerAxis + (gy >> kBrickBits)) * bricksPerAxis + (gx >> kBrickBits);
+    return (brick << (3 * kBrickBits)) + osmc_brick_local(gx, gy, gz);
+  }
+  // Octree nodes live in an arena of fixed-size blocks addressed by 32-bit indices
+  static const int kNodeBlockBits = 12;
+  static const unsigned int kNullNode = 0xFFFFFFFFu;
+  // Vertex key of extraction vertices that no grid feature shares
+  static const unsigned long long kUnsharedVertexKey = ~0ULL;
+
+  // Morton code with the octant digit layout of get_index_on (x -> bit 0,
+  // y -> bit 1, z -> bit 2); coordinates up to 21 bits
+  static inline unsigned long long osmc_spread_bits3(unsigned int v)
+  {
+    unsigned long long x = v & 0x1FFFFFu;
+    x = (x | (x << 32)) & 0x1F00000000FFFFULL;
+    x = (x | (x << 16)) & 0x1F0000FF0000FFULL;
+    x = (x | (x << 8)) & 0x100F00F00F00F00FULL;
+    x = (x | (x << 4)) & 0x10C30C30C30C30C3ULL;
+    x = (x | (x << 2)) & 0x1249249249249249ULL;
+    return x;
+  }
+
+  // Index of the lowest set bit (x != 0)
+  static inline int osmc_lowest_bit(unsigned long long x)
+  {
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return static_cast<int>(index);
+#else
+    return __builtin_ctzll(x);
+#endif
+  }
+
+  static inline unsigned int osmc_compact_bits3(unsigned long long x)
+  {
+    x &= 0x1249249249249249ULL;
+    x = (x | (x >> 2)) & 0x10C30C30C30C30C3ULL;
+    x = (x | (x >> 4)) & 0x100F00F00F00F00FULL;
+    x = (x | (x >> 8)) & 0x1F0000FF0000FFULL;
+    x = (x | (x >> 16)) & 0x1F00000000FFFFULL;
+    x = (x | (x >> 32)) & 0x1FFFFFULL;
+    return static_cast<unsigned int>(x);
+  }
+
+  static inline unsigned long long osmc_morton_encode(int x, int y, int z)
+  {
+    return osmc_spread_bits3(x) | (osmc_spread_bits3(y) << 1) | (osmc_spread_bits3(z) << 2);
+  }
+
+  // What construct_tree keeps per grid point: the inside/outside bit only, or
+  // also the field value (relative to the isovalue) so extraction can
+  // interpolate edges without evaluating the field again
+  enum OSMCCornerCache
+  {
+    OSMC_CORNER_BITS = 0,
+    OSMC_CORNER_FLOAT,
+    OSMC_CORNER_HALF
+  };
+
+  // IEEE half precision conversion (round to nearest even)
+  static inline unsigned short osmc_float_to_half(float f)
+  {
+    unsigned int x;
+    memcpy(&x, &f, sizeof(x));
+    unsigned int sign = (x >> 16) & 0x8000u;
+    int exp = static_cast<int>((x >> 23) & 0xFF) - 127 + 15;
+    unsigned int mant = x & 0x7FFFFFu;
+    if (((x >> 23) & 0xFF) == 0xFF)
+      return static_cast<unsigned short>(sign | 0x7C00u | (mant != 0 ? 0x200u : 0));
+    if (exp >= 31)
+      return static_cast<unsigned short>(sign | 0x7C00u);
+    if (exp <= 0)
+    {
+      if (exp < -10)
+        return static_cast<unsigned short>(sign);
+      mant |= 0x800000u;
+      int shift = 14 - exp;
+      unsigned int h = mant >> shift;
+      unsigned int rem = mant & ((1u << shift) - 1);
+      unsigned int halfway = 1u << (shift - 1);
+      if (rem > halfway || (rem == halfway && (h & 1)))
+        h++;
+      return static_cast<unsigned short>(sign | h);
+    }
+    unsigned int h = sign | (static_cast<unsigned int>(exp) << 10) | (mant >> 13);
+    unsigned int rem = mant & 0x1FFFu;
+    if (rem > 0x1000u || (rem == 0x1000u && (h & 1)))
+      h++;
+    return static_cast<unsigned short>(h);
+  }
+
+  static inline float osmc_half_to_float(unsigned short h)
+  {
+    unsigned int sign = static_cast<unsigned int>(h & 0x8000u) << 16;
+    int exp = (h >> 10) & 0x1F;
+    unsigned int mant = h & 0x3FFu;
+    unsigned int x;
+    if (exp == 0)
+    {
+      if (mant == 0)
+        x = sign;
+      else
+      {
+        exp = 1;
+        while ((mant & 0x400u) == 0)
+        {
+          mant <<= 1;
+          exp--;
+        }
+        mant &= 0x3FFu;
+        x = sign | (static_cast<unsigned int>(exp + 127 - 15) << 23) | (mant << 13);
+      }
+    }
+    else if (exp == 31)
+      x = sign | 0x7F800000u | (mant << 13);
+    else
+      x = sign | (static_cast<unsigned int>(exp + 127 - 15) << 23) | (mant << 13);
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+  }
+
+  // Indexed triangle mesh: xyz per vertex in positions and normals, three
+  // vertex indices per triangle
+  struct OSMCMeshBuffers
+  {
+    vector<float> positions;
+    vector<float> normals;
+    vector<uint32_t> indices;
+  };
+
+  // Wall time (ms) of each gen_mesh stage
+  struct OSMCTiming
+  {
+    long long construct;
+    long long shrink;
+    long long extract;
+    long long total;
+    OSMCTiming() : construct(0), shrink(0), extract(0), total(0) {}
+  };
+
   static const int kCornerOffset[8][3] = {
       {0, 0, 0},
       {1, 0, 0},
@@ -304,12 +486,57 @@ namespace MeshLib
       {0, 3, 8, -1},
       {-1}};
 
-  class COctreeSMC
+  // Octree simplified marching cubes extractor, parameterized on the field
+  // functor type so that a concrete field (e.g. a lambda) is inlined into the
+  // sampling loops. COctreeSMC is the type-erased std::function variant.
+  template <typename TField>
+  class CFieldOctreeSMC
   {
   public:
-    COctreeSMC(std::function<double(const CPoint&)> implicitFunc, double isovalue, const CPoint& bboxMin, const CPoint& bboxMax, int maxDepth = 6);
-    ~COctreeSMC();
+    CFieldOctreeSMC(TField implicitFunc, double isovalue, const CPoint& bboxMin, const CPoint& bboxMax, int maxDepth = 6);
+    // Only available for the std::function instantiation (COctreeSMC)
+    CFieldOctreeSMC(OSMCBatchFunc batchFunc, double isovalue, const CPoint& bboxMin, const CPoint& bboxMax, int maxDepth = 6);
+    ~CFieldOctreeSMC();
     CTMesh *gen_mesh();
+    // Same surface as gen_mesh() written to flat vertex/index arrays without
+    // building a halfedge mesh (see osmc_buffers_to_mesh, osmc_write_ply/stl)
+    void gen_mesh(OSMCMeshBuffers &buffers);
+    // Number of worker threads used by the voxel scan, shrink and extraction
+    // (1 = serial; the mesh is identical for any count)
+    void set_num_threads(int n);
+    // Stage timings of the last gen_mesh call
+    const OSMCTiming &timing() const { return m_timing; }
+    // Sparse narrow-band sampling: find the surface by descent from the root
+    // (always subdividing down to probeDepth) and follow it cell to cell,
+    // storing corner states in hashed bricks. Allows depths up to kMaxSparseDepth.
+    // With a cull test (set_lipschitz_bound / set_interval_func) the descent
+    // prunes by that bound and finds every boundary cell of the dense build.
+    // Without one, the bound is estimated as twice the steepest slope between
+    // neighbouring samples of the 2^probeDepth grid, and the descent keeps every
+    // node within that band of the isovalue, so thin features and small
+    // components between samples are still found. A field that is much steeper
+    // somewhere between those samples than anywhere on them should pass a bound.
+    void set_sparse_sampling(bool enable, int probeDepth = 5);
+    // Top-down construction that skips octree nodes the surface provably cannot
+    // cross: |f(center) - isovalue| > L * halfDiagonal for a Lipschitz bound L,
+    // or an interval range excluding the isovalue. Either one enables culling.
+    void set_lipschitz_bound(double lipschitz);
+    void set_interval_func(OSMCIntervalFunc intervalFunc);
+    // Linear octree: keep the leaves as a Morton-sorted array instead of a
+    // pointer tree; shrink merges sibling runs level by level and extraction
+    // scans the array. Produces the same leaves and mesh as the pointer tree.
+    void set_linear_octree(bool enable);
+    // Keep field values at the sampled grid points (float or half, dense or in
+    // the sparse bricks); extraction then interpolates from them
+    void set_corner_cache(OSMCCornerCache mode);
+    // Analytic gradient used for per-vertex normals and to orient triangles.
+    // Without it triangles keep the MC table winding and vertex normals are
+    // area-weighted face normals, so extraction evaluates no gradients.
+    void set_gradient_func(OSMCGradientFunc gradientFunc);
+    // Adaptive extraction: every merged planar leaf is emitted as one polygon
+    // instead of per-cell MC; its boundary keeps the crossings finer
+    // neighbours create, so the mesh stays watertight
+    void set_adaptive_extraction(bool enable);
 
   private:
     struct BoxRange
@@ -328,137 +555,273 @@ namespace MeshLib
 
     struct NodeParms
     {
-      unsigned char config;
       int d;
+      unsigned char config;
       bool valid;
-      NodeParms() : config(0), d(0), valid(false) {}
+      NodeParms() : d(0), config(0), valid(false) {}
     };
 
+    // Children and parent are indices into the node pool. The box range is not
+    // stored: morton holds the path from the root (one octant digit per level,
+    // see get_index_on) and layerIndex the cell size exponent.
     struct OctreeNode
     {
-      OctreeNode *children[8];
-      OctreeNode *parent;
-      BoxRange range;
-      int indexInParent;
-      int layerIndex;
-      bool visited;
+      unsigned long long morton;
+      unsigned int children[8];
+      unsigned int parent;
       NodeParms parms;
+      unsigned char layerIndex;
+      bool visited;
 
-      OctreeNode()
+      void reset()
       {
-        parent = NULL;
-        indexInParent = -1;
+        morton = 0;
+        parent = kNullNode;
+        parms = NodeParms();
         layerIndex = 0;
         visited = false;
-        for (int i = 0; i < 8; ++i)
-          children[i] = NULL;
-      }
-      ~OctreeNode()
-      {
         clear_children();
       }
       bool is_leaf() const
       {
         for (int i = 0; i < 8; ++i)
-          if (children[i] != NULL)
+          if (children[i] != kNullNode)
             return false;
         return true;
       }
+      // Detached subtrees stay in the pool until the next reset
       void clear_children()
       {
         for (int i = 0; i < 8; ++i)
-        {
-          if (children[i] != NULL)
-          {
-            delete children[i];
-            children[i] = NULL;
-          }
-        }
+          children[i] = kNullNode;
       }
     };
 
-    struct EdgeKey
+    // Arena of octree nodes in blocks of 2^kNodeBlockBits; blocks are kept
+    // across gen_mesh calls so the whole tree is released by reset()
+    class NodePool
     {
-      int a;
-      int b;
-      bool operator<(const EdgeKey &rhs) const
+    public:
+      NodePool() : m_count(0) {}
+      ~NodePool()
+      {
+        for (size_t i = 0; i < m_blocks.size(); ++i)
+          delete[] m_blocks[i];
+      }
+      unsigned int allocate()
+      {
+        if ((m_count >> kNodeBlockBits) == m_blocks.size())
+          m_blocks.push_back(new OctreeNode[static_cast<size_t>(1) << kNodeBlockBits]);
+        unsigned int index = m_count++;
+        (*this)[index].reset();
+        return index;
+      }
+      OctreeNode &operator[](unsigned int index)
+      {
+        return m_blocks[index >> kNodeBlockBits][index & ((1u << kNodeBlockBits) - 1)];
+      }
+      const OctreeNode &operator[](unsigned int index) const
+      {
+        return m_blocks[index >> kNodeBlockBits][index & ((1u << kNodeBlockBits) - 1)];
+      }
+      void reset() { m_count = 0; }
+      unsigned int size() const { return m_count; }
+      size_t capacity_bytes() const
       {
-        if (a != rhs.a)
-          return a < rhs.a;
-        return b < rhs.b;
+        return m_blocks.size() * (static_cast<size_t>(1) << kNodeBlockBits) * sizeof(OctreeNode);
       }
+
+    private:
+      NodePool(const NodePool &);
+      NodePool &operator=(const NodePool &);
+      vector<OctreeNode *> m_blocks;
+      unsigned int m_count;
     };
 
-    struct VertKey
+    // Output vertices keyed by the grid feature they lie on (see edge_vertex_key)
+    // (stores the vertex index + 1)
+    typedef CKeyIndex<unsigned int> VertexMap;
+    // Per undirected output edge (packed vertex-id pair): use count in bits
+    // 0-1, bit 2 = used from the smaller to the larger id, bit 3 = reverse
+    typedef CKeyIndex<unsigned char> EdgeUseMap;
+
+    // Extraction result: welded vertices (double precision until written out)
+    // and triangle index triples, plus the lookup tables used to build them.
+    // keys holds the grid feature key of each vertex (kUnsharedVertexKey for
+    // polygon centroids). A local output is one worker's part of a parallel
+    // extraction: its triangles skip can_add_face until merge_extract_output.
+    struct ExtractOutput
     {
-      long long x;
-      long long y;
-      long long z;
-      bool operator<(const VertKey &rhs) const
-      {
-        if (x != rhs.x)
-          return x < rhs.x;
-        if (y != rhs.y)
-          return y < rhs.y;
-        return z < rhs.z;
-      }
+      vector<CPoint> points;
+      vector<CPoint> normals;
+      vector<unsigned long long> keys;
+      vector<unsigned int> indices;
+      VertexMap vmap;
+      EdgeUseMap edgeUse;
+      bool local;
+      ExtractOutput() : local(false) {}
+    };
+
+    struct BoundaryCell
+    {
+      int x;
+      int y;
+      int z;
+      unsigned char config;
+    };
+
+    // Crossed unit grid edge on the boundary of a merged leaf and the next
+    // one along the traced surface boundary
+    struct LeafFaceEdge
+    {
+      int g[3];
+      int axis;
+      unsigned int next;
+      bool visited;
+    };
+
+    // Boundary cell recorded by the scan, keyed by its Morton code
+    struct MortonCell
+    {
+      unsigned long long code;
+      unsigned char config;
+    };
+
+    // Leaf of the linear octree: anchor is the Morton code of its minimum cell
+    struct LinearNode
+    {
+      unsigned long long anchor;
+      NodeParms parms;
+      unsigned char layerIndex;
     };
 
   private:
+    void init(double isovalue, const CPoint &bboxMin, const CPoint &bboxMax, int maxDepth);
+    void set_depth(int depth);
+    void sample_batch(const double *xs, const double *ys, const double *zs, double *values, int count) const;
+    void sample_corners(const CPoint corners[8], double values[8]) const;
     bool point_inside(const CPoint &p) const;
-    CPoint gradient(const CPoint &p) const;
-    CPoint intersect_edge(const CPoint &p0, const CPoint &p1) const;
-    void refine_point_state();
+    void extract_surface(ExtractOutput &out);
+    void finish_timing(std::chrono::steady_clock::time_point tStart, long long msOutput);
+    static void release_lookup(ExtractOutput &out);
+    void finish_vertex_normals(ExtractOutput &out) const;
+    CPoint intersect_edge(const CPoint &p0, const CPoint &p1, double f0, double f1) const;
+    double edge_crossing(double f0, double f1) const;
+    unsigned long long edge_vertex_key(int gx, int gy, int gz, int axis) const;
+    unsigned long long grid_point_key(const CPoint &g) const;
     bool point_state(int gx, int gy, int gz) const;
+    signed char sampled_point_state(int gx, int gy, int gz) const;
+    signed char dense_point_state(int gx, int gy, int gz) const;
+    void set_dense_point_state(int gx, int gy, int gz, bool inside);
+    void scan_brick(int bx, int by, int bz, vector<BoundaryCell> &cells) const;
     unsigned char cell_config(int x, int y, int z) const;
     int get_index_on(int x, int y, int z, int bitIndex) const;
-    void init_child_range(OctreeNode *node, OctreeNode *parent, int index) const;
+    BoxRange node_range(const OctreeNode *node) const;
+    OctreeNode *child_node(const OctreeNode *node, int i) const;
     OctreeNode *create_to_leaf(int x, int y, int z);
+    void insert_boundary_cell(int x, int y, int z, unsigned char config);
+    void sample_point_planes(int gz0, int gz1);
+    void scan_slab(int z0, int z1, vector<BoundaryCell> &cells) const;
     void construct_tree();
+    void construct_tree_parallel();
+    void construct_tree_top_down();
+    void discover_surface(int x0, int y0, int z0, int size, int depth, vector<long long> &seeds);
+    double estimate_lipschitz() const;
+    bool has_cull_test() const;
+    bool node_may_contain_surface(int x0, int y0, int z0, int size) const;
+    signed char sparse_point_state(int gx, int gy, int gz) const;
+    long long point_slot(int gx, int gy, int gz) const;
+    void store_point_value(size_t slot, double value);
+    bool load_point_value(int gx, int gy, int gz, double &value) const;
+    bool load_corner_values(int x, int y, int z, double values[8]) const;
+    unsigned char sample_cell_config(int x, int y, int z);
+    long long cell_key(int x, int y, int z) const;
     void shrink_tree();
+    void shrink_tree_parallel();
+    void merge_candidates(const vector<OctreeNode *> &candidates, size_t begin, size_t end, vector<char> &merged);
+    void shrink_tree_linear();
     bool can_merge_node(OctreeNode *node, int &D) const;
-    unsigned char calculate_config(OctreeNode *children[8]) const;
+    bool can_merge_parms(const NodeParms *children[8], int &D) const;
+    unsigned char calculate_config(const OctreeNode *node) const;
+    unsigned char calculate_config(const NodeParms *children[8]) const;
+    void extract_range(const BoxRange &range, ExtractOutput &out) const;
+    void extract_leaf(const BoxRange &range, ExtractOutput &out) const;
+    void extract_leaves(const vector<BoxRange> &leaves, size_t begin, size_t end, ExtractOutput &out) const;
+    void extract_leaves_parallel(const vector<BoxRange> &leaves, ExtractOutput &out) const;
+    void merge_extract_output(const ExtractOutput &part, ExtractOutput &out) const;
+    bool is_leaf_at(int x, int y, int z, int layer) const;
+    static bool morton_cell_order(const MortonCell &a, const MortonCell &b) { return a.code < b.code; }
+    static bool linear_extract_order(const LinearNode &a, const LinearNode &b)
+    {
+      return a.layerIndex > b.layerIndex || (a.layerIndex == b.layerIndex && a.anchor < b.anchor);
+    }
     int calculate_d(int cx, int cy, int cz, unsigned char config) const;
     CPoint grid_to_world(double gx, double gy, double gz) const;
-    void generate_face(OctreeNode *node, CTMesh *out, int &vid, int &fid,
-                       map<VertKey, CTMesh::CVertex *> &vmap,
-                       map<EdgeKey, int> &edgeUse,
-                       map<EdgeKey, int> &dirEdgeUse,
-                       double quant) const;
-    void generate_face_leaf(OctreeNode *node, CTMesh *out, int &vid, int &fid,
-                            map<VertKey, CTMesh::CVertex *> &vmap,
-                            map<EdgeKey, int> &edgeUse,
-                            map<EdgeKey, int> &dirEdgeUse,
-                            double quant) const;
-    void generate_cell_mc(int x, int y, int z, unsigned char cfg, CTMesh *out, int &vid, int &fid,
-                map<VertKey, CTMesh::CVertex *> &vmap,
-                map<EdgeKey, int> &edgeUse,
-                map<EdgeKey, int> &dirEdgeUse,
-                double quant) const;
-    CPoint get_intersected_point_at_edge(const BoxRange &range, int edgeIndex, const OSMCInt3 &normal, int d) const;
-    bool can_add_face(vector<CTMesh::CVertex *> &verts,
-                      map<EdgeKey, int> &edgeUse,
-                      map<EdgeKey, int> &dirEdgeUse) const;
-    CTMesh::CVertex *get_vertex(const CPoint &p,
-                                CTMesh *out,
-                                int &vid,
-                                map<VertKey, CTMesh::CVertex *> &vmap,
-                                double quant) const;
+    void generate_face(const BoxRange &range, ExtractOutput &out) const;
+    bool trace_leaf_boundary(const int lo[3], int size, vector<LeafFaceEdge> &edges) const;
+    void generate_cell_mc(int x, int y, int z, unsigned char cfg, ExtractOutput &out) const;
+    unsigned int edge_crossing_vertex(int gx, int gy, int gz, int axis, ExtractOutput &out) const;
+    static unsigned long long edge_use_key(int a, int b)
+    {
+      unsigned long long lo = static_cast<unsigned int>(a < b ? a : b);
+      unsigned long long hi = static_cast<unsigned int>(a < b ? b : a);
+      return (lo << 32) | hi;
+    }
+    static unsigned char edge_use_dir_bit(int a, int b) { return a < b ? 4 : 8; }
+    bool can_add_face(unsigned int *verts, int n, EdgeUseMap &edgeUse) const;
+    void emit_triangle(unsigned int tri[3], ExtractOutput &out) const;
+    unsigned int get_vertex(unsigned long long key, const CPoint &p, ExtractOutput &out) const;
+    unsigned int new_vertex(unsigned long long key, const CPoint &p, ExtractOutput &out) const;
 
   private:
-    std::function<double(const CPoint&)> m_implicitFunc;
+    TField m_implicitFunc;
+    OSMCBatchFunc m_batchFunc;
+    OSMCIntervalFunc m_intervalFunc;
+    OSMCGradientFunc m_gradientFunc;
+    double m_lipschitz;
+    // Lipschitz bound estimated for a sparse descent without a cull test
+    double m_bandLipschitz;
+    mutable std::atomic<long long> m_sampleCount;
     double m_isovalue;
     int m_maxDepth;
     int m_scale;
     CPoint m_rootMin;
     CPoint m_rootMax;
     double m_step;
+    mutable NodePool m_nodes;
     OctreeNode *m_root;
     queue<OctreeNode *> m_queue;
-    vector<signed char> m_pointState;
+    bool m_linear;
+    bool m_adaptive;
+    vector<LinearNode> m_linearLeaves;
+    // Boundary cells of the last scan, sorted by Morton code once the tree is
+    // built: the cells of any leaf form one contiguous run
+    vector<MortonCell> m_boundaryCells;
+    // Adaptive extraction: merged leaves whose boundary does not trace, keyed
+    // by anchor Morton code * (kMaxSparseDepth + 1) + layer
+    unordered_set<unsigned long long> m_untracedLeaves;
+    // Dense corner states, one bit per grid point in m_pointBricks^3 bricks
+    // (see osmc_brick_slot): m_pointInside (1 = inside) and m_pointSampled
+    // (1 = sampled), the latter left empty when the full scan samples every point
+    vector<unsigned long long> m_pointInside;
+    vector<unsigned long long> m_pointSampled;
+    int m_pointBricks;
     int m_pointGridSize;
+    int m_numThreads;
+    int m_requestedDepth;
+    double m_boxLength;
+    bool m_sparse;
+    int m_probeDepth;
+    unordered_map<long long, size_t> m_brickIndex;
+    vector<signed char> m_brickPool;
+    OSMCCornerCache m_cornerCache;
+    vector<float> m_pointValues;
+    vector<unsigned short> m_pointHalves;
+    OSMCTiming m_timing;
   };
 
+  typedef CFieldOctreeSMC<OSMCScalarFunc> COctreeSMC;
+
   static const int kPointDeltaCS[8][3] = {
       {0, 1, 1},
       {0, 1, 0},
@@ -490,25 +853,32 @@ namespace MeshLib
   static const int kMidVoxelIndexCS[8] = {4, 0, 7, 3, 5, 1, 6, 2};
   static const unsigned char kNormalNotSimple = 13;
 
+  // Generated from the kPointDeltaCS corners: a config is planar when exactly one
+  // normal n of kNormalTypeIdToNormal separates its corners, i.e. n.p of every
+  // outside corner (bit set) is above n.p of every inside corner, or every one is
+  // below. kConfigToNormalTypeId holds n (kNormalNotSimple otherwise) and
+  // kConfigToEqType numbers the planar configs in order (55 otherwise); eq type k
+  // is the plane (n, d) in kEqTypeToEqQuad, d being the inside n.p nearest to
+  // the outside corners.
   static const unsigned char kConfigToNormalTypeId[256] = {
       13, 0, 1, 2, 3, 13, 4, 13, 5, 6, 13, 13, 7, 13, 13, 8, 3, 9, 13, 13, 13, 13, 13, 13, 13, 13, 13, 0, 13, 13, 13, 13,
       5, 13, 10, 13, 13, 13, 13, 1, 13, 13, 13, 13, 13, 13, 13, 13, 7, 13, 13, 11, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 2,
       0, 13, 13, 13, 9, 13, 13, 13, 13, 13, 13, 13, 13, 13, 3, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13,
-      13, 6, 13, 13, 13, 13, 13, 12, 13, 13, 13, 13, 13, 13, 13, 13, 4, 13, 13, 5, 13, 13, 13, 13, 10, 13, 13, 13, 13, 13, 13, 13,
-      1, 1, 13, 13, 13, 13, 13, 13, 13, 10, 13, 13, 13, 13, 5, 13, 13, 4, 13, 13, 13, 13, 13, 13, 13, 13, 12, 13, 13, 13, 13, 13,
-      6, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 3, 13, 13, 13, 13, 13, 13, 13, 13, 9, 13, 13, 13, 0,
+      6, 13, 13, 13, 13, 13, 12, 13, 13, 13, 13, 13, 13, 13, 13, 4, 13, 13, 5, 13, 13, 13, 13, 10, 13, 13, 13, 13, 13, 13, 13, 1,
+      1, 13, 13, 13, 13, 13, 13, 13, 10, 13, 13, 13, 13, 5, 13, 13, 4, 13, 13, 13, 13, 13, 13, 13, 13, 12, 13, 13, 13, 13, 13, 6,
+      13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 3, 13, 13, 13, 13, 13, 13, 13, 13, 13, 9, 13, 13, 13, 0,
       2, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 13, 11, 13, 13, 7, 13, 13, 13, 13, 13, 13, 13, 13, 1, 13, 13, 13, 13, 10, 13, 5,
       13, 13, 13, 13, 0, 13, 13, 13, 13, 13, 13, 13, 13, 13, 9, 3, 8, 13, 13, 7, 13, 13, 6, 5, 13, 4, 13, 3, 2, 1, 0, 13};
 
   static const unsigned char kConfigToEqType[256] = {
       55, 0, 1, 2, 3, 55, 4, 55, 5, 6, 55, 55, 7, 55, 55, 8, 9, 10, 55, 55, 55, 55, 55, 55, 55, 55, 55, 11, 55, 55, 55, 55,
       12, 55, 13, 55, 55, 55, 55, 14, 55, 55, 55, 55, 55, 55, 55, 55, 15, 55, 55, 16, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 17,
-      18, 55, 55, 55, 19, 55, 55, 55, 55, 55, 55, 55, 55, 20, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55,
-      0, 21, 55, 55, 55, 55, 55, 22, 55, 55, 55, 55, 55, 55, 55, 55, 23, 55, 55, 24, 55, 55, 55, 55, 25, 55, 55, 55, 0, 55, 0, 0,
-      26, 27, 55, 55, 55, 55, 55, 55, 55, 55, 28, 55, 55, 55, 55, 29, 55, 55, 30, 55, 55, 55, 55, 55, 55, 55, 55, 31, 55, 55, 55, 55,
-      55, 32, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 0, 55, 33, 55, 55, 55, 55, 55, 0, 55, 55, 55, 34, 55, 0,
-      0, 35, 36, 55, 55, 55, 55, 55, 55, 55, 55, 55, 37, 55, 55, 38, 55, 55, 55, 55, 55, 55, 55, 0, 39, 55, 55, 0, 55, 40, 0, 41,
-      55, 55, 55, 55, 42, 55, 55, 0, 55, 55, 55, 0, 55, 0, 43, 44, 45, 55, 55, 46, 55, 0, 47, 48, 55, 49, 0, 50, 51, 52, 53, 55};
+      18, 55, 55, 55, 19, 55, 55, 55, 55, 55, 55, 55, 55, 55, 20, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55,
+      21, 55, 55, 55, 55, 55, 22, 55, 55, 55, 55, 55, 55, 55, 55, 23, 55, 55, 24, 55, 55, 55, 55, 25, 55, 55, 55, 55, 55, 55, 55, 26,
+      27, 55, 55, 55, 55, 55, 55, 55, 28, 55, 55, 55, 55, 29, 55, 55, 30, 55, 55, 55, 55, 55, 55, 55, 55, 31, 55, 55, 55, 55, 55, 32,
+      55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 33, 55, 55, 55, 55, 55, 55, 55, 55, 55, 34, 55, 55, 55, 35,
+      36, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 55, 37, 55, 55, 38, 55, 55, 55, 55, 55, 55, 55, 55, 39, 55, 55, 55, 55, 40, 55, 41,
+      55, 55, 55, 55, 42, 55, 55, 55, 55, 55, 55, 55, 55, 55, 43, 44, 45, 55, 55, 46, 55, 55, 47, 48, 55, 49, 55, 50, 51, 52, 53, 55};
 
   static const OSMCInt3 kNormalTypeIdToNormal[13] = {
       {1, -1, -1}, {1, -1, 1}, {1, -1, 0}, {1, 1, 1}, {1, 0, 1}, {1, 1, -1}, {1, 0, -1}, {1, 1, 0}, {1, 0, 0}, {0, 1, 1}, {0, 1, -1}, {0, 1, 0}, {0, 0, 1}};
@@ -521,15 +891,42 @@ namespace MeshLib
       {1, -1, 0, 0}, {0, 1, 0, 1}, {1, 1, 0, 2}, {1, -1, 1, 0}, {0, 1, -1, 1}, {1, 1, -1, 2}, {1, -1, -1, -1}, {0, 1, 1, 2}, {1, 1, 1, 3},
       {1, 0, 0, 0}, {1, 1, 0, 0}, {1, 0, -1, -1}, {1, 1, -1, -1}, {1, 0, 1, 0}, {1, 1, 1, 0}, {1, -1, 0, -1}, {1, -1, 1, -1}, {1, -1, -1, -2}};
 
-  inline COctreeSMC::COctreeSMC(std::function<double(const CPoint&)> implicitFunc, double isovalue, const CPoint& bboxMin, const CPoint& bboxMax, int maxDepth)
-    : m_implicitFunc(implicitFunc), m_isovalue(isovalue)
+  template <typename TField>
+  inline CFieldOctreeSMC<TField>::CFieldOctreeSMC(TField implicitFunc, double isovalue, const CPoint& bboxMin, const CPoint& bboxMax, int maxDepth)
+    : m_implicitFunc(implicitFunc)
   {
-    m_maxDepth = maxDepth > 0 ? maxDepth : 1;
-    if (m_maxDepth > 9)
-      m_maxDepth = 9;
-    m_scale = 1 << m_maxDepth;
+    init(isovalue, bboxMin, bboxMax, maxDepth);
+  }
+
+  template <typename TField>
+  inline CFieldOctreeSMC<TField>::CFieldOctreeSMC(OSMCBatchFunc batchFunc, double isovalue, const CPoint& bboxMin, const CPoint& bboxMax, int maxDepth)
+    : m_batchFunc(batchFunc)
+  {
+    m_implicitFunc = [batchFunc](const CPoint &p) -> double
+    {
+      double x = p[0], y = p[1], z = p[2];
+      double value = 0;
+      batchFunc(&x, &y, &z, &value, 1);
+      return value;
+    };
+    init(isovalue, bboxMin, bboxMax, maxDepth);
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::init(double isovalue, const CPoint &bboxMin, const CPoint &bboxMax, int maxDepth)
+  {
+    m_isovalue = isovalue;
     m_root = NULL;
-    
+    m_numThreads = 1;
+    m_sparse = false;
+    m_linear = false;
+    m_adaptive = false;
+    m_cornerCache = OSMC_CORNER_BITS;
+    m_probeDepth = 5;
+    m_lipschitz = 0;
+    m_bandLipschitz = 0;
+    m_sampleCount = 0;
+
     m_rootMin = bboxMin;
     m_rootMax = bboxMax;
     CPoint size = m_rootMax - m_rootMin;
@@ -540,52 +937,163 @@ namespace MeshLib
       max_len = size[2];
     if (max_len <= 1e-12)
       max_len = 1.0;
-    m_step = max_len / static_cast<double>(m_scale);
+    m_boxLength = max_len;
+
+    m_requestedDepth = maxDepth > 0 ? maxDepth : 1;
+    set_depth(m_requestedDepth);
+  }
+
+  // Clamp the depth to what the current storage mode supports and derive the grid size
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_depth(int depth)
+  {
+    int maxDepth = m_sparse ? kMaxSparseDepth : kMaxDenseDepth;
+    m_maxDepth = depth < maxDepth ? depth : maxDepth;
+    m_scale = 1 << m_maxDepth;
+    m_step = m_boxLength / static_cast<double>(m_scale);
+  }
+
+  template <typename TField>
+  inline CFieldOctreeSMC<TField>::~CFieldOctreeSMC()
+  {
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_num_threads(int n)
+  {
+    m_numThreads = n > 0 ? n : 1;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_sparse_sampling(bool enable, int probeDepth)
+  {
+    m_sparse = enable;
+    m_probeDepth = probeDepth > 0 ? probeDepth : 0;
+    set_depth(m_requestedDepth);
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_linear_octree(bool enable)
+  {
+    m_linear = enable;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_corner_cache(OSMCCornerCache mode)
+  {
+    m_cornerCache = mode;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_gradient_func(OSMCGradientFunc gradientFunc)
+  {
+    m_gradientFunc = gradientFunc;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_adaptive_extraction(bool enable)
+  {
+    m_adaptive = enable;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_lipschitz_bound(double lipschitz)
+  {
+    m_lipschitz = lipschitz > 0 ? lipschitz : 0;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_interval_func(OSMCIntervalFunc intervalFunc)
+  {
+    m_intervalFunc = intervalFunc;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::sample_batch(const double *xs, const double *ys, const double *zs, double *values, int count) const
+  {
+    m_sampleCount += count;
+    if (m_batchFunc)
+    {
+      m_batchFunc(xs, ys, zs, values, count);
+      return;
+    }
+    // Scalar field: adapted point by point; inlined when TField is a concrete functor
+    for (int i = 0; i < count; ++i)
+      values[i] = m_implicitFunc(CPoint(xs[i], ys[i], zs[i]));
   }
 
-  inline COctreeSMC::~COctreeSMC()
+  // Evaluate the field at the 8 corners of a cell in one batch
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::sample_corners(const CPoint corners[8], double values[8]) const
   {
-    if (m_root != NULL)
-      delete m_root;
+    double xs[8], ys[8], zs[8];
+    for (int k = 0; k < 8; ++k)
+    {
+      xs[k] = corners[k][0];
+      ys[k] = corners[k][1];
+      zs[k] = corners[k][2];
+    }
+    sample_batch(xs, ys, zs, values, 8);
   }
 
-  inline bool COctreeSMC::point_inside(const CPoint &p) const
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::point_inside(const CPoint &p) const
   {
     return m_implicitFunc(p) < m_isovalue;
   }
 
   // Compute implicit function gradient (numerical differentiation)
-  inline CPoint COctreeSMC::gradient(const CPoint &p) const
+  // Compute precise isosurface intersection on an edge (linear interpolation)
+  // from the field values sampled at its end points
+  template <typename TField>
+  inline CPoint CFieldOctreeSMC<TField>::intersect_edge(const CPoint &p0, const CPoint &p1, double f0, double f1) const
   {
-    const double h = 1e-5;
-    double fx_pos = m_implicitFunc(CPoint(p[0] + h, p[1], p[2]));
-    double fx_neg = m_implicitFunc(CPoint(p[0] - h, p[1], p[2]));
-    double fy_pos = m_implicitFunc(CPoint(p[0], p[1] + h, p[2]));
-    double fy_neg = m_implicitFunc(CPoint(p[0], p[1] - h, p[2]));
-    double fz_pos = m_implicitFunc(CPoint(p[0], p[1], p[2] + h));
-    double fz_neg = m_implicitFunc(CPoint(p[0], p[1], p[2] - h));
-    return CPoint((fx_pos - fx_neg) / (2.0 * h),
-                  (fy_pos - fy_neg) / (2.0 * h),
-                  (fz_pos - fz_neg) / (2.0 * h));
+    return p0 + (p1 - p0) * edge_crossing(f0, f1);
   }
 
-  // Compute precise isosurface intersection on an edge (linear interpolation)
-  inline CPoint COctreeSMC::intersect_edge(const CPoint &p0, const CPoint &p1) const
+  // Edge parameter in [0, 1] of the isosurface crossing between two samples
+  template <typename TField>
+  inline double CFieldOctreeSMC<TField>::edge_crossing(double f0, double f1) const
   {
-    double f0 = m_implicitFunc(p0) - m_isovalue;
-    double f1 = m_implicitFunc(p1) - m_isovalue;
-    
+    f0 -= m_isovalue;
+    f1 -= m_isovalue;
+
     // Fallback: if values are equal or have same sign, return midpoint
     if (fabs(f1 - f0) < 1e-12 || f0 * f1 > 0)
-      return (p0 + p1) * 0.5;
-    
+      return 0.5;
+
     // Find zero crossing by linear interpolation
     double t = -f0 / (f1 - f0);
-    t = std::max(0.0, std::min(1.0, t));  // Clamp to [0,1]
-    return p0 + (p1 - p0) * t;
+    return std::max(0.0, std::min(1.0, t));  // Clamp to [0,1]
+  }
+
+  // Key of an output vertex lying on the unit grid edge from (gx, gy, gz) along
+  // axis (0..2), or on the grid point itself (axis 3)
+  template <typename TField>
+  inline unsigned long long CFieldOctreeSMC<TField>::edge_vertex_key(int gx, int gy, int gz, int axis) const
+  {
+    unsigned long long g = static_cast<unsigned long long>(m_pointGridSize);
+    return (((static_cast<unsigned long long>(gz) * g + gy) * g + gx) << 2) | static_cast<unsigned long long>(axis);
+  }
+
+  // Vertex key of a point given in grid coordinates that lies on a grid line
+  template <typename TField>
+  inline unsigned long long CFieldOctreeSMC<TField>::grid_point_key(const CPoint &g) const
+  {
+    int c[3];
+    int axis = 3;
+    for (int i = 0; i < 3; ++i)
+    {
+      double f = floor(g[i]);
+      c[i] = static_cast<int>(f);
+      if (g[i] != f)
+        axis = i;
+    }
+    return edge_vertex_key(c[0], c[1], c[2], axis);
   }
 
-  inline int COctreeSMC::get_index_on(int x, int y, int z, int bitIndex) const
+  template <typename TField>
+  inline int CFieldOctreeSMC<TField>::get_index_on(int x, int y, int z, int bitIndex) const
   {
     int ret = 0;
     if ((x & (1 << bitIndex)) != 0)
@@ -597,64 +1105,53 @@ namespace MeshLib
     return ret;
   }
 
-  inline void COctreeSMC::init_child_range(OctreeNode *node, OctreeNode *parent, int index) const
+  // Box range of a node from its Morton path and layer
+  template <typename TField>
+  inline typename CFieldOctreeSMC<TField>::BoxRange CFieldOctreeSMC<TField>::node_range(const OctreeNode *node) const
   {
-    int dx = (parent->range.xmax - parent->range.xmin + 1) >> 1;
-    int dy = (parent->range.ymax - parent->range.ymin + 1) >> 1;
-    int dz = (parent->range.zmax - parent->range.zmin + 1) >> 1;
-    if ((index & 1) == 0)
-    {
-      node->range.xmin = parent->range.xmin;
-      node->range.xmax = parent->range.xmin + dx - 1;
-    }
-    else
-    {
-      node->range.xmin = parent->range.xmin + dx;
-      node->range.xmax = parent->range.xmax;
-    }
-    if ((index & 2) == 0)
-    {
-      node->range.ymin = parent->range.ymin;
-      node->range.ymax = parent->range.ymin + dy - 1;
-    }
-    else
-    {
-      node->range.ymin = parent->range.ymin + dy;
-      node->range.ymax = parent->range.ymax;
-    }
-    if ((index & 4) == 0)
-    {
-      node->range.zmin = parent->range.zmin;
-      node->range.zmax = parent->range.zmin + dz - 1;
-    }
-    else
-    {
-      node->range.zmin = parent->range.zmin + dz;
-      node->range.zmax = parent->range.zmax;
-    }
+    int size = 1 << node->layerIndex;
+    BoxRange range;
+    range.xmin = static_cast<int>(osmc_compact_bits3(node->morton)) << node->layerIndex;
+    range.ymin = static_cast<int>(osmc_compact_bits3(node->morton >> 1)) << node->layerIndex;
+    range.zmin = static_cast<int>(osmc_compact_bits3(node->morton >> 2)) << node->layerIndex;
+    range.xmax = range.xmin + size - 1;
+    range.ymax = range.ymin + size - 1;
+    range.zmax = range.zmin + size - 1;
+    return range;
+  }
+
+  template <typename TField>
+  inline typename CFieldOctreeSMC<TField>::OctreeNode *CFieldOctreeSMC<TField>::child_node(const OctreeNode *node, int i) const
+  {
+    unsigned int index = node->children[i];
+    return index == kNullNode ? NULL : &m_nodes[index];
   }
 
-  inline COctreeSMC::OctreeNode *COctreeSMC::create_to_leaf(int x, int y, int z)
+  template <typename TField>
+  inline typename CFieldOctreeSMC<TField>::OctreeNode *CFieldOctreeSMC<TField>::create_to_leaf(int x, int y, int z)
   {
-    OctreeNode *node = m_root;
+    unsigned int index = 0;
     for (int i = 1; i <= m_maxDepth; ++i)
     {
       int idx = get_index_on(x, y, z, m_maxDepth - i);
-      if (node->children[idx] == NULL)
+      unsigned int childIndex = m_nodes[index].children[idx];
+      if (childIndex == kNullNode)
       {
-        OctreeNode *child = new OctreeNode();
-        child->parent = node;
-        child->indexInParent = idx;
-        child->layerIndex = node->layerIndex - 1;
-        init_child_range(child, node, idx);
-        node->children[idx] = child;
+        childIndex = m_nodes.allocate();
+        OctreeNode &parent = m_nodes[index];
+        OctreeNode &child = m_nodes[childIndex];
+        child.parent = index;
+        child.morton = (parent.morton << 3) | static_cast<unsigned long long>(idx);
+        child.layerIndex = static_cast<unsigned char>(parent.layerIndex - 1);
+        parent.children[idx] = childIndex;
       }
-      node = node->children[idx];
+      index = childIndex;
     }
-    return node;
+    return &m_nodes[index];
   }
 
-  inline int COctreeSMC::calculate_d(int cx, int cy, int cz, unsigned char config) const
+  template <typename TField>
+  inline int CFieldOctreeSMC<TField>::calculate_d(int cx, int cy, int cz, unsigned char config) const
   {
     unsigned char eq = kConfigToEqType[config];
     if (eq >= 54)
@@ -663,15 +1160,29 @@ namespace MeshLib
     return e.d + e.a * cx + e.b * cy + e.c * cz;
   }
 
-  inline unsigned char COctreeSMC::calculate_config(OctreeNode *children[8]) const
+  template <typename TField>
+  inline unsigned char CFieldOctreeSMC<TField>::calculate_config(const OctreeNode *node) const
+  {
+    const NodeParms *children[8];
+    for (int i = 0; i < 8; ++i)
+    {
+      OctreeNode *c = child_node(node, i);
+      children[i] = c != NULL ? &c->parms : NULL;
+    }
+    return calculate_config(children);
+  }
+
+  // Merged config from the child parms in octant order (NULL = no child)
+  template <typename TField>
+  inline unsigned char CFieldOctreeSMC<TField>::calculate_config(const NodeParms *children[8]) const
   {
     unsigned char firstc = 0;
     int firstIndex = -1;
     for (int i = 0; i < 8; ++i)
     {
-      if (children[i] != NULL && children[i]->parms.valid)
+      if (children[i] != NULL && children[i]->valid)
       {
-        firstc = children[i]->parms.config;
+        firstc = children[i]->config;
         firstIndex = i;
         break;
       }
@@ -684,33 +1195,47 @@ namespace MeshLib
     for (int i = 0; i < 8; ++i)
     {
       unsigned char cfg = midValue;
-      if (children[i] != NULL && children[i]->parms.valid)
-        cfg = children[i]->parms.config;
+      if (children[i] != NULL && children[i]->valid)
+        cfg = children[i]->config;
       unsigned char flag = kPointFlagCS[kVertexVoxelIndexCS[i]];
       ret |= (cfg & flag);
     }
     return static_cast<unsigned char>(ret);
   }
 
-  inline bool COctreeSMC::can_merge_node(OctreeNode *node, int &D) const
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::can_merge_node(OctreeNode *node, int &D) const
+  {
+    const NodeParms *children[8];
+    for (int i = 0; i < 8; ++i)
+    {
+      OctreeNode *c = child_node(node, i);
+      children[i] = c != NULL ? &c->parms : NULL;
+    }
+    return can_merge_parms(children, D);
+  }
+
+  // Children can merge when all are valid with the same simple plane (normal type and d)
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::can_merge_parms(const NodeParms *children[8], int &D) const
   {
     unsigned char normalType = kNormalNotSimple;
     bool found = false;
     for (int i = 0; i < 8; ++i)
     {
-      OctreeNode *c = node->children[i];
+      const NodeParms *c = children[i];
       if (c != NULL)
       {
-        if (!c->parms.valid)
+        if (!c->valid)
           return false;
-        unsigned char nt = kConfigToNormalTypeId[c->parms.config];
+        unsigned char nt = kConfigToNormalTypeId[c->config];
         if (nt == kNormalNotSimple)
           return false;
         if (!found)
         {
           found = true;
           normalType = nt;
-          D = c->parms.d;
+          D = c->d;
         }
       }
     }
@@ -718,25 +1243,27 @@ namespace MeshLib
       return false;
     for (int i = 0; i < 8; ++i)
     {
-      OctreeNode *c = node->children[i];
+      const NodeParms *c = children[i];
       if (c != NULL)
       {
-        unsigned char nt = kConfigToNormalTypeId[c->parms.config];
-        if (nt != normalType || c->parms.d != D)
+        unsigned char nt = kConfigToNormalTypeId[c->config];
+        if (nt != normalType || c->d != D)
           return false;
       }
     }
     return true;
   }
 
-  inline CPoint COctreeSMC::grid_to_world(double gx, double gy, double gz) const
+  template <typename TField>
+  inline CPoint CFieldOctreeSMC<TField>::grid_to_world(double gx, double gy, double gz) const
   {
     return CPoint(m_rootMin[0] + gx * m_step,
                   m_rootMin[1] + gy * m_step,
                   m_rootMin[2] + gz * m_step);
   }
 
-  inline void COctreeSMC::construct_tree()
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::construct_tree()
   {
     long long totalCells = static_cast<long long>(m_scale) * m_scale * m_scale;
     long long processed = 0;
@@ -744,590 +1271,1667 @@ namespace MeshLib
     int zLogStep = m_scale / 20;
     if (zLogStep < 1)
       zLogStep = 1;
-    long long cellLogStep = totalCells / 200;
-    if (cellLogStep < 1000)
-      cellLogStep = 1000;
 
     m_pointGridSize = m_scale + 1;
-    m_pointState.assign(static_cast<size_t>(m_pointGridSize) * m_pointGridSize * m_pointGridSize, -1);
-    auto pointIndex = [&](int gx, int gy, int gz) -> size_t
+    m_sampleCount = 0;
+    m_brickIndex.clear();
+    m_brickPool.clear();
+    m_pointValues.clear();
+    m_pointHalves.clear();
+    m_pointBricks = (m_pointGridSize + kBrickSize - 1) >> kBrickBits;
+    m_pointInside.clear();
+    m_pointSampled.clear();
+    if (!m_sparse)
     {
-      return (static_cast<size_t>(gz) * m_pointGridSize + gy) * m_pointGridSize + gx;
-    };
-    auto pointInsideCached = [&](int gx, int gy, int gz) -> bool
-    {
-      size_t idx = pointIndex(gx, gy, gz);
-      signed char &st = m_pointState[idx];
-      if (st < 0)
-      {
-        CPoint p = grid_to_world(static_cast<double>(gx), static_cast<double>(gy), static_cast<double>(gz));
-        st = point_inside(p) ? 1 : 0;
-      }
-      return st > 0;
-    };
+      size_t points = static_cast<size_t>(m_pointBricks) * m_pointBricks * m_pointBricks << (3 * kBrickBits);
+      size_t words = points >> 6;
+      m_pointInside.assign(words, 0);
+      if (has_cull_test())
+        m_pointSampled.assign(words, 0);
+      if (m_cornerCache == OSMC_CORNER_FLOAT)
+        m_pointValues.assign(points, 0.0f);
+      else if (m_cornerCache == OSMC_CORNER_HALF)
+        m_pointHalves.assign(points, 0);
+    }
 
     cout << "[OctreeSMC] ConstructTree start, cells=" << totalCells << endl;
 
-    for (int z = 0; z < m_scale; ++z)
+    if (m_sparse || has_cull_test())
     {
-      for (int y = 0; y < m_scale; ++y)
-      {
-        for (int x = 0; x < m_scale; ++x)
-        {
-          unsigned char value = 0;
-          for (int pi = 0; pi < 8; ++pi)
-          {
-            int gx = x + kPointDeltaCS[pi][0];
-            int gy = y + kPointDeltaCS[pi][1];
-            int gz = z + kPointDeltaCS[pi][2];
-            if (!pointInsideCached(gx, gy, gz))  // bit=1 means outside, consistent with MC
-              value |= kPointFlagCS[pi];
-          }
-          if (value != 0 && value != 255)
-          {
-            OctreeNode *leaf = create_to_leaf(x, y, z);
-            leaf->parms.valid = true;
-            leaf->parms.config = value;
-            leaf->parms.d = calculate_d(x, y, z, value);
-            boundaryCells++;
-            leaf->visited = true;
-            if (leaf->parent != NULL && !leaf->parent->visited)
-            {
-              leaf->parent->visited = true;
-              m_queue.push(leaf->parent);
-            }
-          }
-          processed++;
-          if ((processed % cellLogStep) == 0)
-          {
-            double pct2 = totalCells > 0 ? (100.0 * processed / totalCells) : 100.0;
-            cout << "[OctreeSMC] ConstructTree fine progress " << pct2 << "% ("
-                 << processed << "/" << totalCells << ")" << endl;
-          }
-        }
-      }
-      if (((z + 1) % zLogStep) == 0 || z + 1 == m_scale)
+      construct_tree_top_down();
+      return;
+    }
+
+    if (m_numThreads > 1)
+    {
+      construct_tree_parallel();
+      return;
+    }
+
+    // One layer of bricks at a time: sample its point planes, then classify
+    // its cells brick by brick
+    vector<BoundaryCell> layerCells;
+    sample_point_planes(0, 1);
+    for (int z0 = 0; z0 < m_scale; z0 += kBrickSize)
+    {
+      int z1 = std::min(z0 + kBrickSize, m_scale);
+      sample_point_planes(z0 + 1, z1 + 1);
+      layerCells.clear();
+      scan_slab(z0, z1, layerCells);
+      for (size_t i = 0; i < layerCells.size(); ++i)
+        insert_boundary_cell(layerCells[i].x, layerCells[i].y, layerCells[i].z, layerCells[i].config);
+      boundaryCells += static_cast<long long>(layerCells.size());
+      processed += static_cast<long long>(z1 - z0) * m_scale * m_scale;
+      if (z1 / zLogStep != z0 / zLogStep || z1 == m_scale)
       {
         double pct = totalCells > 0 ? (100.0 * processed / totalCells) : 100.0;
-        cout << "[OctreeSMC] ConstructTree progress " << pct << "% (z=" << (z + 1) << "/" << m_scale
+        cout << "[OctreeSMC] ConstructTree progress " << pct << "% (z=" << z1 << "/" << m_scale
              << ", boundary=" << boundaryCells << ")" << endl;
       }
     }
     cout << "[OctreeSMC] ConstructTree done, boundary cells=" << boundaryCells << endl;
-
-    refine_point_state();
-  }
-
-  inline bool COctreeSMC::point_state(int gx, int gy, int gz) const
-  {
-    size_t idx = (static_cast<size_t>(gz) * m_pointGridSize + gy) * m_pointGridSize + gx;
-    return m_pointState[idx] > 0;
   }
 
-  inline unsigned char COctreeSMC::cell_config(int x, int y, int z) const
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::insert_boundary_cell(int x, int y, int z, unsigned char config)
   {
-    unsigned char cfg = 0;
-    for (int pi = 0; pi < 8; ++pi)
+    MortonCell cell;
+    cell.code = osmc_morton_encode(x, y, z);
+    cell.config = config;
+    m_boundaryCells.push_back(cell);
+    if (m_linear)
     {
-      int gx = x + kPointDeltaCS[pi][0];
-      int gy = y + kPointDeltaCS[pi][1];
-      int gz = z + kPointDeltaCS[pi][2];
-      if (!point_state(gx, gy, gz))  // bit=1 means outside, consistent with MC
-        cfg |= kPointFlagCS[pi];
+      LinearNode leaf;
+      leaf.anchor = osmc_morton_encode(x, y, z);
+      leaf.parms.valid = true;
+      leaf.parms.config = config;
+      leaf.parms.d = calculate_d(x, y, z, config);
+      leaf.layerIndex = 0;
+      m_linearLeaves.push_back(leaf);
+      return;
+    }
+    OctreeNode *leaf = create_to_leaf(x, y, z);
+    leaf->parms.valid = true;
+    leaf->parms.config = config;
+    leaf->parms.d = calculate_d(x, y, z, config);
+    leaf->visited = true;
+    if (leaf->parent != kNullNode && !m_nodes[leaf->parent].visited)
+    {
+      m_nodes[leaf->parent].visited = true;
+      m_queue.push(&m_nodes[leaf->parent]);
     }
-    return cfg;
   }
 
-  inline void COctreeSMC::refine_point_state()
+  // Sample every grid point on the planes gz0 <= gz < gz1, one batch per x row
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::sample_point_planes(int gz0, int gz1)
   {
-    long long refined = 0;
-    for (int z = 0; z < m_scale; ++z)
+    int n = m_pointGridSize;
+    vector<double> xs(n), ys(n), zs(n), values(n);
+    for (int gx = 0; gx < n; ++gx)
+      xs[gx] = m_rootMin[0] + gx * m_step;
+    for (int gz = gz0; gz < gz1; ++gz)
     {
-      for (int y = 0; y < m_scale; ++y)
+      double wz = m_rootMin[2] + gz * m_step;
+      for (int gy = 0; gy < n; ++gy)
       {
-        for (int x = 0; x < m_scale; ++x)
+        double wy = m_rootMin[1] + gy * m_step;
+        std::fill(ys.begin(), ys.end(), wy);
+        std::fill(zs.begin(), zs.end(), wz);
+        sample_batch(&xs[0], &ys[0], &zs[0], &values[0], n);
+        for (int gx = 0; gx < n; ++gx)
         {
-          unsigned char cfg = cell_config(x, y, z);
-          if (cfg == 0 || cfg == 255)
-            continue;
-          for (int pi = 0; pi < 8; ++pi)
-          {
-            int gx = x + kPointDeltaCS[pi][0];
-            int gy = y + kPointDeltaCS[pi][1];
-            int gz = z + kPointDeltaCS[pi][2];
-            size_t idx = (static_cast<size_t>(gz) * m_pointGridSize + gy) * m_pointGridSize + gx;
-            CPoint p = grid_to_world(static_cast<double>(gx), static_cast<double>(gy), static_cast<double>(gz));
-            m_pointState[idx] = point_inside(p) ? 1 : 0;
-          }
-          refined++;
+          size_t slot = osmc_brick_slot(gx, gy, gz, m_pointBricks);
+          if (values[gx] < m_isovalue)
+            m_pointInside[slot >> 6] |= 1ULL << (slot & 63);
+          if (m_cornerCache != OSMC_CORNER_BITS)
+            store_point_value(slot, values[gx]);
         }
       }
     }
-    cout << "[OctreeSMC] Refine points for connectivity, cells=" << refined << " (smoothing disabled)" << endl;
   }
 
-  inline void COctreeSMC::shrink_tree()
+  // Classify the cells of slab z0 <= z < z1 brick by brick; z0 is a multiple of
+  // kBrickSize and z1 one or m_scale. The point planes must already be sampled.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::scan_slab(int z0, int z1, vector<BoundaryCell> &cells) const
   {
-    long long popped = 0;
-    long long merged = 0;
-    cout << "[OctreeSMC] Shrink start, initial queue=" << m_queue.size() << endl;
-    while (!m_queue.empty())
+    int bricks = (m_scale + kBrickSize - 1) >> kBrickBits;
+    for (int bz = z0 >> kBrickBits; (bz << kBrickBits) < z1; ++bz)
+      for (int by = 0; by < bricks; ++by)
+        for (int bx = 0; bx < bricks; ++bx)
+          scan_brick(bx, by, bz, cells);
+  }
+
+  // Boundary cells of one brick, an 8 x 8 slice (64 cells) per word: the slice
+  // words at z and z + 1, shifted by one point in x and y with the bits of the
+  // neighbouring bricks, give the 8 corners of every cell. ANDing and ORing
+  // them marks the cells whose corners disagree, so all-inside and all-outside
+  // slices are skipped without touching a cell. Requires the fully sampled
+  // dense grid.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::scan_brick(int bx, int by, int bz, vector<BoundaryCell> &cells) const
+  {
+    static const unsigned long long kByteLow = 0x0101010101010101ULL;
+    int x0 = bx << kBrickBits;
+    int y0 = by << kBrickBits;
+    int z0 = bz << kBrickBits;
+    int nx = std::min(m_scale - x0, kBrickSize);
+    int ny = std::min(m_scale - y0, kBrickSize);
+    int nz = std::min(m_scale - z0, kBrickSize);
+    unsigned long long valid = ((1ULL << nx) - 1) * kByteLow;
+    if (ny < kBrickSize)
+      valid &= (1ULL << (ny << 3)) - 1;
+
+    // Slice word of brick (bx + dx, by + dy) at height z; 0 past the grid
+    auto slice = [&](int dx, int dy, int z) -> unsigned long long
     {
-      OctreeNode *node = m_queue.front();
-      m_queue.pop();
-      popped++;
-      node->visited = false;
-      int D = INT_MIN;
-      if (can_merge_node(node, D))
+      if (bx + dx >= m_pointBricks || by + dy >= m_pointBricks)
+        return 0;
+      return m_pointInside[osmc_brick_slot(x0 + (dx << kBrickBits), y0 + (dy << kBrickBits), z, m_pointBricks) >> 6];
+    };
+    for (int lz = 0; lz < nz; ++lz)
+    {
+      // Corner words indexed dx + 2 * dy + 4 * dz
+      unsigned long long c[8];
+      for (int dz = 0; dz < 2; ++dz)
       {
-        node->parms.valid = true;
-        node->parms.config = calculate_config(node->children);
-        node->parms.d = D;
-        node->clear_children();
-        merged++;
-        if (node->parent != NULL && !node->parent->visited)
-        {
-          node->parent->visited = true;
-          m_queue.push(node->parent);
-        }
+        int z = z0 + lz + dz;
+        unsigned long long w = slice(0, 0, z);
+        unsigned long long wx = slice(1, 0, z);
+        unsigned long long wy = slice(0, 1, z);
+        unsigned long long wxy = slice(1, 1, z);
+        unsigned long long nextX = ((w >> 1) & ~(kByteLow << 7)) | ((wx & kByteLow) << 7);
+        unsigned long long nextXY = ((wy >> 1) & ~(kByteLow << 7)) | ((wxy & kByteLow) << 7);
+        c[4 * dz] = w;
+        c[4 * dz + 1] = nextX;
+        c[4 * dz + 2] = (w >> 8) | (wy << 56);
+        c[4 * dz + 3] = (nextX >> 8) | (nextXY << 56);
       }
-      if ((popped % 5000) == 0)
+      unsigned long long all = ~0ULL;
+      unsigned long long any = 0;
+      for (int k = 0; k < 8; ++k)
       {
-        cout << "[OctreeSMC] Shrink progress popped=" << popped << ", merged=" << merged
-             << ", queue=" << m_queue.size() << endl;
+        all &= c[k];
+        any |= c[k];
+      }
+      unsigned long long boundary = any & ~all & valid;
+      while (boundary != 0)
+      {
+        int b = osmc_lowest_bit(boundary);
+        boundary &= boundary - 1;
+        unsigned char cfg = 0;
+        for (int pi = 0; pi < 8; ++pi)
+        {
+          int k = kPointDeltaCS[pi][0] + 2 * kPointDeltaCS[pi][1] + 4 * kPointDeltaCS[pi][2];
+          if (((c[k] >> b) & 1) == 0)  // bit=1 means outside, consistent with MC
+            cfg |= kPointFlagCS[pi];
+        }
+        BoundaryCell cell;
+        cell.x = x0 + (b & (kBrickSize - 1));
+        cell.y = y0 + (b >> kBrickBits);
+        cell.z = z0 + lz;
+        cell.config = cfg;
+        cells.push_back(cell);
       }
     }
-    cout << "[OctreeSMC] Shrink done, popped=" << popped << ", merged=" << merged << endl;
   }
 
-  inline CPoint COctreeSMC::get_intersected_point_at_edge(const BoxRange &range, int edgeIndex, const OSMCInt3 &normal, int d) const
-  {
-    double x = 0, y = 0, z = 0;
-    switch (edgeIndex)
-    {
-    case 0:
-      x = range.xmin;
-      y = range.ymax + 1;
-      z = normal.z != 0 ? static_cast<double>(d - normal.x * x - normal.y * y) / normal.z : range.zmin;
-      break;
-    case 2:
-      x = range.xmin;
-      y = range.ymin;
-      z = normal.z != 0 ? static_cast<double>(d - normal.x * x - normal.y * y) / normal.z : range.zmin;
-      break;
-    case 4:
-      x = range.xmax + 1;
-      y = range.ymax + 1;
-      z = normal.z != 0 ? static_cast<double>(d - normal.x * x - normal.y * y) / normal.z : range.zmin;
-      break;
-    case 6:
-      x = range.xmax + 1;
-      y = range.ymin;
-      z = normal.z != 0 ? static_cast<double>(d - normal.x * x - normal.y * y) / normal.z : range.zmin;
-      break;
-    case 8:
-      y = range.ymax + 1;
-      z = range.zmax + 1;
-      x = normal.x != 0 ? static_cast<double>(d - normal.y * y - normal.z * z) / normal.x : range.xmin;
-      break;
-    case 9:
-      y = range.ymax + 1;
-      z = range.zmin;
-      x = normal.x != 0 ? static_cast<double>(d - normal.y * y - normal.z * z) / normal.x : range.xmin;
-      break;
-    case 10:
-      y = range.ymin;
-      z = range.zmin;
-      x = normal.x != 0 ? static_cast<double>(d - normal.y * y - normal.z * z) / normal.x : range.xmin;
-      break;
-    case 11:
-      y = range.ymin;
-      z = range.zmax + 1;
-      x = normal.x != 0 ? static_cast<double>(d - normal.y * y - normal.z * z) / normal.x : range.xmin;
-      break;
-    case 1:
-      x = range.xmin;
-      z = range.zmin;
-      y = normal.y != 0 ? static_cast<double>(d - normal.x * x - normal.z * z) / normal.y : range.ymin;
-      break;
-    case 3:
-      x = range.xmin;
-      z = range.zmax + 1;
-      y = normal.y != 0 ? static_cast<double>(d - normal.x * x - normal.z * z) / normal.y : range.ymin;
-      break;
-    case 5:
-      x = range.xmax + 1;
-      z = range.zmin;
-      y = normal.y != 0 ? static_cast<double>(d - normal.x * x - normal.z * z) / normal.y : range.ymin;
-      break;
-    default:
-      x = range.xmax + 1;
-      z = range.zmax + 1;
-      y = normal.y != 0 ? static_cast<double>(d - normal.x * x - normal.z * z) / normal.y : range.ymin;
-      break;
-    }
-    return grid_to_world(x, y, z);
-  }
-
-  inline CTMesh::CVertex *COctreeSMC::get_vertex(const CPoint &p,
-                                                 CTMesh *out,
-                                                 int &vid,
-                                                 map<VertKey, CTMesh::CVertex *> &vmap,
-                                                 double quant) const
-  {
-    VertKey k;
-    k.x = static_cast<long long>(llround(p[0] * quant));
-    k.y = static_cast<long long>(llround(p[1] * quant));
-    k.z = static_cast<long long>(llround(p[2] * quant));
-    CTMesh::CVertex *&v = vmap[k];
-    if (v == NULL)
-    {
-      v = out->createVertex(vid++);
-      v->point() = p;
-    }
-    return v;
-  }
-
-  inline bool COctreeSMC::can_add_face(vector<CTMesh::CVertex *> &verts,
-                                   map<EdgeKey, int> &edgeUse,
-                                   map<EdgeKey, int> &dirEdgeUse) const
-  {
-    size_t n = verts.size();
-    if (n < 3)
-      return false;
-    // Check degenerate triangle (duplicate vertices)
-    for (size_t i = 0; i < n; ++i)
+  // Slab-parallel scan: workers own disjoint z ranges of the point grid and collect
+  // their boundary cells locally; inserts are replayed in serial scan order so the
+  // tree (and shrink queue) is identical to the single-threaded build.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::construct_tree_parallel()
+  {
+    // Slabs are whole layers of bricks
+    int layers = (m_scale + kBrickSize - 1) >> kBrickBits;
+    int nThreads = m_numThreads;
+    if (nThreads > layers)
+      nThreads = layers;
+
+    vector<int> slabBegin(nThreads + 1);
+    for (int t = 0; t <= nThreads; ++t)
+      slabBegin[t] = std::min(m_scale, (layers * t / nThreads) << kBrickBits);
+
+    vector<thread> workers;
+    for (int t = 0; t < nThreads; ++t)
     {
-      int a = verts[i]->id();
-      int b = verts[(i + 1) % n]->id();
-      if (a == b)
+      int gz0 = slabBegin[t];
+      int gz1 = (t + 1 == nThreads) ? m_pointGridSize : slabBegin[t + 1];
+      workers.push_back(thread(&CFieldOctreeSMC<TField>::sample_point_planes, this, gz0, gz1));
+    }
+    for (size_t t = 0; t < workers.size(); ++t)
+      workers[t].join();
+    workers.clear();
+    cout << "[OctreeSMC] ConstructTree sampled points, threads=" << nThreads << endl;
+
+    vector<vector<BoundaryCell> > slabCells(nThreads);
+    for (int t = 0; t < nThreads; ++t)
+      workers.push_back(thread(&CFieldOctreeSMC<TField>::scan_slab, this, slabBegin[t], slabBegin[t + 1], std::ref(slabCells[t])));
+    for (size_t t = 0; t < workers.size(); ++t)
+      workers[t].join();
+
+    long long boundaryCells = 0;
+    for (int t = 0; t < nThreads; ++t)
+    {
+      const vector<BoundaryCell> &cells = slabCells[t];
+      for (size_t i = 0; i < cells.size(); ++i)
+        insert_boundary_cell(cells[i].x, cells[i].y, cells[i].z, cells[i].config);
+      boundaryCells += static_cast<long long>(cells.size());
+    }
+    cout << "[OctreeSMC] ConstructTree done, boundary cells=" << boundaryCells << endl;
+  }
+
+  template <typename TField>
+  inline long long CFieldOctreeSMC<TField>::cell_key(int x, int y, int z) const
+  {
+    return (static_cast<long long>(z) * m_scale + y) * m_scale + x;
+  }
+
+  // Sampled state of a grid point in the brick store: 1 inside, 0 outside, -1 not sampled
+  template <typename TField>
+  inline signed char CFieldOctreeSMC<TField>::sparse_point_state(int gx, int gy, int gz) const
+  {
+    long long slot = point_slot(gx, gy, gz);
+    return slot < 0 ? -1 : m_brickPool[slot];
+  }
+
+  // Storage index of a grid point: in the dense grid, or in the brick pool
+  // (-1 when its brick was never allocated)
+  template <typename TField>
+  inline long long CFieldOctreeSMC<TField>::point_slot(int gx, int gy, int gz) const
+  {
+    if (!m_sparse)
+      return static_cast<long long>(osmc_brick_slot(gx, gy, gz, m_pointBricks));
+    long long key = (static_cast<long long>(gz >> kBrickBits) << 42) |
+                    (static_cast<long long>(gy >> kBrickBits) << 21) |
+                    static_cast<long long>(gx >> kBrickBits);
+    unordered_map<long long, size_t>::const_iterator it = m_brickIndex.find(key);
+    if (it == m_brickIndex.end())
+      return -1;
+    return static_cast<long long>(it->second + osmc_brick_local(gx, gy, gz));
+  }
+
+  // Values are kept relative to the isovalue so that half precision spends its
+  // bits near the surface
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::store_point_value(size_t slot, double value)
+  {
+    float rel = static_cast<float>(value - m_isovalue);
+    if (m_cornerCache == OSMC_CORNER_FLOAT)
+      m_pointValues[slot] = rel;
+    else
+      m_pointHalves[slot] = osmc_float_to_half(rel);
+  }
+
+  // Cached field values at the corners of a cell in kCornerOffset order;
+  // false when values are not kept or a corner was never sampled
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::load_corner_values(int x, int y, int z, double values[8]) const
+  {
+    for (int k = 0; k < 8; ++k)
+    {
+      if (!load_point_value(x + kCornerOffset[k][0], y + kCornerOffset[k][1], z + kCornerOffset[k][2], values[k]))
         return false;
     }
-    
-    // Check edge usage count (manifold condition: each edge shared by at most 2 faces)
-    for (size_t i = 0; i < n; ++i)
+    return true;
+  }
+
+  // Cached field value at one grid point
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::load_point_value(int gx, int gy, int gz, double &value) const
+  {
+    if (m_cornerCache == OSMC_CORNER_BITS)
+      return false;
+    long long slot = point_slot(gx, gy, gz);
+    if (slot < 0 || (m_sparse ? m_brickPool[slot] : dense_point_state(gx, gy, gz)) < 0)
+      return false;
+    double rel = m_cornerCache == OSMC_CORNER_FLOAT ? m_pointValues[slot] : osmc_half_to_float(m_pointHalves[slot]);
+    value = rel + m_isovalue;
+    return true;
+  }
+
+  // Config of a cell for the top-down scan; unsampled corners are sampled in
+  // one batch (in sparse mode their bricks are allocated on demand)
+  template <typename TField>
+  inline unsigned char CFieldOctreeSMC<TField>::sample_cell_config(int x, int y, int z)
+  {
+    const size_t brickVolume = static_cast<size_t>(kBrickSize) * kBrickSize * kBrickSize;
+    size_t slots[8];
+    signed char states[8];
+    double xs[8], ys[8], zs[8], values[8];
+    int missing[8];
+    int nMissing = 0;
+    for (int pi = 0; pi < 8; ++pi)
     {
-      int a = verts[i]->id();
-      int b = verts[(i + 1) % n]->id();
-      EdgeKey und{a < b ? a : b, a < b ? b : a};
-      if (edgeUse[und] >= 2)
-        return false;  // Edge already used twice
+      int gx = x + kPointDeltaCS[pi][0];
+      int gy = y + kPointDeltaCS[pi][1];
+      int gz = z + kPointDeltaCS[pi][2];
+      if (m_sparse)
+      {
+        long long key = (static_cast<long long>(gz >> kBrickBits) << 42) |
+                        (static_cast<long long>(gy >> kBrickBits) << 21) |
+                        static_cast<long long>(gx >> kBrickBits);
+        unordered_map<long long, size_t>::iterator it = m_brickIndex.find(key);
+        if (it == m_brickIndex.end())
+        {
+          it = m_brickIndex.insert(std::make_pair(key, m_brickPool.size())).first;
+          m_brickPool.resize(m_brickPool.size() + brickVolume, -1);
+          if (m_cornerCache == OSMC_CORNER_FLOAT)
+            m_pointValues.resize(m_brickPool.size(), 0.0f);
+          else if (m_cornerCache == OSMC_CORNER_HALF)
+            m_pointHalves.resize(m_brickPool.size(), 0);
+        }
+        slots[pi] = it->second + osmc_brick_local(gx, gy, gz);
+        states[pi] = m_brickPool[slots[pi]];
+      }
+      else
+      {
+        slots[pi] = osmc_brick_slot(gx, gy, gz, m_pointBricks);
+        states[pi] = dense_point_state(gx, gy, gz);
+      }
+      if (states[pi] < 0)
+      {
+        xs[nMissing] = m_rootMin[0] + gx * m_step;
+        ys[nMissing] = m_rootMin[1] + gy * m_step;
+        zs[nMissing] = m_rootMin[2] + gz * m_step;
+        missing[nMissing++] = pi;
+      }
     }
-    
-    // Detect direction conflicts and flip if needed
-    bool needFlip = false;
-    for (size_t i = 0; i < n; ++i)
+    if (nMissing > 0)
     {
-      int a = verts[i]->id();
-      int b = verts[(i + 1) % n]->id();
-      EdgeKey dir{a, b};
-      if (dirEdgeUse[dir] > 0)
+      sample_batch(xs, ys, zs, values, nMissing);
+      for (int i = 0; i < nMissing; ++i)
       {
-        needFlip = true;
-        break;
+        int pi = missing[i];
+        bool inside = values[i] < m_isovalue;
+        if (m_sparse)
+          m_brickPool[slots[pi]] = inside ? 1 : 0;
+        else
+          set_dense_point_state(x + kPointDeltaCS[pi][0], y + kPointDeltaCS[pi][1], z + kPointDeltaCS[pi][2], inside);
+        states[pi] = inside ? 1 : 0;
+        if (m_cornerCache != OSMC_CORNER_BITS)
+          store_point_value(slots[pi], values[i]);
       }
     }
-    if (needFlip)
-      reverse(verts.begin() + 1, verts.end());
+    unsigned char cfg = 0;
+    for (int pi = 0; pi < 8; ++pi)
+    {
+      if (states[pi] == 0)  // bit=1 means outside, consistent with MC
+        cfg |= kPointFlagCS[pi];
+    }
+    return cfg;
+  }
 
-    // Re-check direction conflicts after flipping
-    for (size_t i = 0; i < n; ++i)
+  // Steepest slope of the field between neighbouring points of the grid with
+  // 2^probeDepth cells per side, sampled one plane at a time
+  template <typename TField>
+  inline double CFieldOctreeSMC<TField>::estimate_lipschitz() const
+  {
+    int n = std::min(1 << std::min(m_probeDepth, m_maxDepth), m_scale);
+    int spacing = m_scale / n;
+    double h = spacing * m_step;
+    size_t plane = static_cast<size_t>(n + 1) * (n + 1);
+    vector<double> xs(plane), ys(plane), zs(plane), prev(plane), cur(plane);
+    double slope = 0;
+    for (int k = 0; k <= n; ++k)
     {
-      int a = verts[i]->id();
-      int b = verts[(i + 1) % n]->id();
-      EdgeKey dir{a, b};
-      if (dirEdgeUse[dir] > 0)
-        return false;  // Direction conflict remains
+      for (int j = 0; j <= n; ++j)
+        for (int i = 0; i <= n; ++i)
+        {
+          size_t p = static_cast<size_t>(j) * (n + 1) + i;
+          xs[p] = m_rootMin[0] + i * h;
+          ys[p] = m_rootMin[1] + j * h;
+          zs[p] = m_rootMin[2] + k * h;
+        }
+      sample_batch(&xs[0], &ys[0], &zs[0], &cur[0], static_cast<int>(plane));
+      for (int j = 0; j <= n; ++j)
+        for (int i = 0; i <= n; ++i)
+        {
+          size_t p = static_cast<size_t>(j) * (n + 1) + i;
+          if (i > 0)
+            slope = std::max(slope, fabs(cur[p] - cur[p - 1]));
+          if (j > 0)
+            slope = std::max(slope, fabs(cur[p] - cur[p - n - 1]));
+          if (k > 0)
+            slope = std::max(slope, fabs(cur[p] - prev[p]));
+        }
+      prev.swap(cur);
     }
+    return slope / h;
+  }
 
-    // Record edge usage
-    for (size_t i = 0; i < n; ++i)
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::has_cull_test() const
+  {
+    return m_lipschitz > 0 || static_cast<bool>(m_intervalFunc);
+  }
+
+  // Conservative test whether the isosurface can cross a node (including its boundary)
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::node_may_contain_surface(int x0, int y0, int z0, int size) const
+  {
+    CPoint boxMin = grid_to_world(static_cast<double>(x0), static_cast<double>(y0), static_cast<double>(z0));
+    CPoint boxMax = grid_to_world(static_cast<double>(x0 + size), static_cast<double>(y0 + size), static_cast<double>(z0 + size));
+    if (m_intervalFunc)
     {
-      int a = verts[i]->id();
-      int b = verts[(i + 1) % n]->id();
-      EdgeKey und{a < b ? a : b, a < b ? b : a};
-      edgeUse[und] += 1;
-      EdgeKey dir{a, b};
-      dirEdgeUse[dir] += 1;
+      double fmin = 0, fmax = 0;
+      m_intervalFunc(boxMin, boxMax, fmin, fmax);
+      if (fmin > m_isovalue || fmax < m_isovalue)
+        return false;
+    }
+    double lipschitz = m_lipschitz > 0 ? m_lipschitz : m_bandLipschitz;
+    if (lipschitz > 0)
+    {
+      CPoint c = (boxMin + boxMax) * 0.5;
+      double xs[1] = {c[0]}, ys[1] = {c[1]}, zs[1] = {c[2]}, value[1];
+      sample_batch(xs, ys, zs, value, 1);
+      double halfDiagonal = 0.5 * sqrt(3.0) * size * m_step;
+      // Small relative slack so round-off never culls a crossing on the node boundary
+      if (fabs(value[0] - m_isovalue) > lipschitz * halfDiagonal * (1.0 + 1e-9))
+        return false;
     }
     return true;
   }
 
-  inline void COctreeSMC::generate_face(OctreeNode *node, CTMesh *out, int &vid, int &fid,
-                                    map<VertKey, CTMesh::CVertex *> &vmap,
-                                    map<EdgeKey, int> &edgeUse,
-                                    map<EdgeKey, int> &dirEdgeUse,
-                                    double quant) const
+  // Hierarchical descent from the root collecting boundary cells as seeds.
+  // With a cull test only nodes the surface may cross are visited, which finds
+  // every boundary cell. Otherwise nodes above the probe depth are always
+  // subdivided and below it nodes are culled by the estimated bound.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::discover_surface(int x0, int y0, int z0, int size, int depth, vector<long long> &seeds)
   {
-    unsigned char cfg = remap_cfg_to_mc(node->parms.config);
-    int nt = kConfigToNormalTypeId[cfg];
-    if (nt >= static_cast<int>(kNormalNotSimple))
+    if (size == 1)
     {
-      generate_face_leaf(node, out, vid, fid, vmap, edgeUse, dirEdgeUse, quant);
+      unsigned char cfg = sample_cell_config(x0, y0, z0);
+      if (cfg != 0 && cfg != 255)
+        seeds.push_back(cell_key(x0, y0, z0));
       return;
     }
-    const OSMCInt3 &normal = kNormalTypeIdToNormal[nt];
+    if ((has_cull_test() || depth >= m_probeDepth) && !node_may_contain_surface(x0, y0, z0, size))
+      return;
+    int half = size >> 1;
+    for (int i = 0; i < 8; ++i)
+      discover_surface(x0 + (i & 1) * half, y0 + ((i >> 1) & 1) * half, z0 + ((i >> 2) & 1) * half, half, depth + 1, seeds);
+  }
 
-    CPoint corners[8];
-    for (int k = 0; k < 8; ++k)
+  // Top-down scan (sparse storage and/or culling): seed boundary cells by
+  // descent. Without a provable cull test the bound is estimated first, and the
+  // surface is then followed across cell faces so every connected component
+  // touched by a seed is completed.
+  // Cells are inserted in (z, y, x) order.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::construct_tree_top_down()
+  {
+    static const int kFaceDelta[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+
+    // Without a cull test, cull by twice the steepest axis slope on the probe
+    // grid (the gradient norm is at most sqrt(3) times its largest component)
+    m_bandLipschitz = 0;
+    if (!has_cull_test())
     {
-      double gx = node->range.xmin + kCornerOffset[k][0] * (node->range.xmax - node->range.xmin + 1);
-      double gy = node->range.ymin + kCornerOffset[k][1] * (node->range.ymax - node->range.ymin + 1);
-      double gz = node->range.zmin + kCornerOffset[k][2] * (node->range.zmax - node->range.zmin + 1);
-      corners[k] = grid_to_world(gx, gy, gz);
+      m_bandLipschitz = std::max(2.0 * estimate_lipschitz(), std::numeric_limits<double>::min());
+      cout << "[OctreeSMC] Estimated Lipschitz bound=" << m_bandLipschitz << endl;
     }
-    CPoint edgeMid[12];
-    for (int e = 0; e < 12; ++e)
+
+    vector<long long> seeds;
+    discover_surface(0, 0, 0, m_scale, 0, seeds);
+    cout << "[OctreeSMC] ConstructTree top-down seeds=" << seeds.size() << endl;
+
+    vector<long long> boundary;
+    unordered_set<long long> visited;
+    vector<long long> front;
+    if (has_cull_test())
+      boundary.swap(seeds);
+    else
     {
-      int a = kEdgeCorners[e][0];
-      int b = kEdgeCorners[e][1];
-      edgeMid[e] = (corners[a] + corners[b]) * 0.5;
+      visited.insert(seeds.begin(), seeds.end());
+      front.swap(seeds);
     }
-    CPoint pmin = corners[0];
-    CPoint pmax = corners[6];
-    const double tol = 1e-9;
-    auto valid_point = [&](const CPoint &p) -> bool
+    long long sliceArea = static_cast<long long>(m_scale) * m_scale;
+    while (!front.empty())
     {
-      if (!(p[0] == p[0] && p[1] == p[1] && p[2] == p[2]))
-        return false;
-      if (p[0] < pmin[0] - tol || p[0] > pmax[0] + tol)
-        return false;
-      if (p[1] < pmin[1] - tol || p[1] > pmax[1] + tol)
-        return false;
-      if (p[2] < pmin[2] - tol || p[2] > pmax[2] + tol)
-        return false;
-      return true;
-    };
+      long long key = front.back();
+      front.pop_back();
+      int z = static_cast<int>(key / sliceArea);
+      int y = static_cast<int>((key / m_scale) % m_scale);
+      int x = static_cast<int>(key % m_scale);
+      unsigned char cfg = sample_cell_config(x, y, z);
+      if (cfg == 0 || cfg == 255)
+        continue;
+      boundary.push_back(key);
+      for (int f = 0; f < 6; ++f)
+      {
+        int nx = x + kFaceDelta[f][0];
+        int ny = y + kFaceDelta[f][1];
+        int nz = z + kFaceDelta[f][2];
+        if (nx < 0 || ny < 0 || nz < 0 || nx >= m_scale || ny >= m_scale || nz >= m_scale)
+          continue;
+        long long nkey = cell_key(nx, ny, nz);
+        if (visited.insert(nkey).second)
+          front.push_back(nkey);
+      }
+    }
 
-    for (int i = 0; kTriTable[cfg][i] != -1; i += 3)
+    std::sort(boundary.begin(), boundary.end());
+    for (size_t i = 0; i < boundary.size(); ++i)
     {
-      int e0 = kTriTable[cfg][i];
-      int e1 = kTriTable[cfg][i + 1];
-      int e2 = kTriTable[cfg][i + 2];
-      CPoint p0 = get_intersected_point_at_edge(node->range, e0, normal, node->parms.d);
-      CPoint p1 = get_intersected_point_at_edge(node->range, e1, normal, node->parms.d);
-      CPoint p2 = get_intersected_point_at_edge(node->range, e2, normal, node->parms.d);
+      long long key = boundary[i];
+      int z = static_cast<int>(key / sliceArea);
+      int y = static_cast<int>((key / m_scale) % m_scale);
+      int x = static_cast<int>(key % m_scale);
+      insert_boundary_cell(x, y, z, cell_config(x, y, z));
+    }
+    cout << "[OctreeSMC] ConstructTree done, boundary cells=" << boundary.size()
+         << ", field samples=" << m_sampleCount;
+    if (m_sparse)
+      cout << ", bricks=" << m_brickIndex.size() << " (" << (m_brickPool.size() >> 20) << " MB)";
+    cout << endl;
+  }
 
-      if (!valid_point(p0))
-        p0 = edgeMid[e0];
-      if (!valid_point(p1))
-        p1 = edgeMid[e1];
-      if (!valid_point(p2))
-        p2 = edgeMid[e2];
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::point_state(int gx, int gy, int gz) const
+  {
+    if (m_sparse)
+      return sparse_point_state(gx, gy, gz) > 0;
+    return dense_point_state(gx, gy, gz) > 0;
+  }
 
-      CPoint n = (p1 - p0) ^ (p2 - p0);
-      if (n.norm() <= 1e-10)
-        continue;
-      vector<CTMesh::CVertex *> tri;
-      tri.push_back(get_vertex(p0, out, vid, vmap, quant));
-      tri.push_back(get_vertex(p1, out, vid, vmap, quant));
-      tri.push_back(get_vertex(p2, out, vid, vmap, quant));
-      if (can_add_face(tri, edgeUse, dirEdgeUse))
-        out->createFace(tri, fid++);
+  // 1 inside, 0 outside, -1 not sampled
+  template <typename TField>
+  inline signed char CFieldOctreeSMC<TField>::sampled_point_state(int gx, int gy, int gz) const
+  {
+    if (m_sparse)
+      return sparse_point_state(gx, gy, gz);
+    return dense_point_state(gx, gy, gz);
+  }
+
+  // Dense grid point state from the brick bits: 1 inside, 0 outside, -1 not sampled
+  template <typename TField>
+  inline signed char CFieldOctreeSMC<TField>::dense_point_state(int gx, int gy, int gz) const
+  {
+    size_t slot = osmc_brick_slot(gx, gy, gz, m_pointBricks);
+    size_t word = slot >> 6;
+    unsigned long long bit = 1ULL << (slot & 63);
+    if (!m_pointSampled.empty() && (m_pointSampled[word] & bit) == 0)
+      return -1;
+    return (m_pointInside[word] & bit) != 0 ? 1 : 0;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::set_dense_point_state(int gx, int gy, int gz, bool inside)
+  {
+    size_t slot = osmc_brick_slot(gx, gy, gz, m_pointBricks);
+    size_t word = slot >> 6;
+    unsigned long long bit = 1ULL << (slot & 63);
+    if (!m_pointSampled.empty())
+      m_pointSampled[word] |= bit;
+    if (inside)
+      m_pointInside[word] |= bit;
+    else
+      m_pointInside[word] &= ~bit;
+  }
+
+  template <typename TField>
+  inline unsigned char CFieldOctreeSMC<TField>::cell_config(int x, int y, int z) const
+  {
+    if (m_sparse)
+    {
+      // Cells with unsampled corners lie off the surface band
+      unsigned char cfg = 0;
+      for (int pi = 0; pi < 8; ++pi)
+      {
+        signed char st = sparse_point_state(x + kPointDeltaCS[pi][0], y + kPointDeltaCS[pi][1], z + kPointDeltaCS[pi][2]);
+        if (st < 0)
+          return 0;
+        if (st == 0)
+          cfg |= kPointFlagCS[pi];
+      }
+      return cfg;
+    }
+    unsigned char cfg = 0;
+    for (int pi = 0; pi < 8; ++pi)
+    {
+      signed char st = dense_point_state(x + kPointDeltaCS[pi][0], y + kPointDeltaCS[pi][1], z + kPointDeltaCS[pi][2]);
+      if (st < 0)  // culled by the top-down scan
+        return 0;
+      if (st == 0)  // bit=1 means outside, consistent with MC
+        cfg |= kPointFlagCS[pi];
+    }
+    return cfg;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::shrink_tree()
+  {
+    long long popped = 0;
+    long long merged = 0;
+    cout << "[OctreeSMC] Shrink start, initial queue=" << m_queue.size() << endl;
+    while (!m_queue.empty())
+    {
+      OctreeNode *node = m_queue.front();
+      m_queue.pop();
+      popped++;
+      node->visited = false;
+      int D = INT_MIN;
+      if (can_merge_node(node, D))
+      {
+        node->parms.valid = true;
+        node->parms.config = calculate_config(node);
+        node->parms.d = D;
+        node->clear_children();
+        merged++;
+        if (node->parent != kNullNode && !m_nodes[node->parent].visited)
+        {
+          m_nodes[node->parent].visited = true;
+          m_queue.push(&m_nodes[node->parent]);
+        }
+      }
+      if ((popped % 5000) == 0)
+      {
+        cout << "[OctreeSMC] Shrink progress popped=" << popped << ", merged=" << merged
+             << ", queue=" << m_queue.size() << endl;
+      }
     }
+    cout << "[OctreeSMC] Shrink done, popped=" << popped << ", merged=" << merged << endl;
   }
 
-  inline void COctreeSMC::generate_face_leaf(OctreeNode *node, CTMesh *out, int &vid, int &fid,
-                                         map<VertKey, CTMesh::CVertex *> &vmap,
-                                         map<EdgeKey, int> &edgeUse,
-                                         map<EdgeKey, int> &dirEdgeUse,
-                                         double quant) const
+  // Merge test for candidates[begin, end); only writes the candidates themselves
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::merge_candidates(const vector<OctreeNode *> &candidates, size_t begin, size_t end, vector<char> &merged)
   {
-    unsigned char cfg = remap_cfg_to_mc(node->parms.config);
-    if (cfg == 0 || cfg == 255)
+    for (size_t i = begin; i < end; ++i)
+    {
+      OctreeNode *node = candidates[i];
+      int D = INT_MIN;
+      if (can_merge_node(node, D))
+      {
+        node->parms.valid = true;
+        node->parms.config = calculate_config(node);
+        node->parms.d = D;
+        node->clear_children();
+        merged[i] = 1;
+      }
+    }
+  }
+
+  // Level-synchronous shrink: all candidate parents of one layer are tested
+  // concurrently (they only read their own children, which are final), then the
+  // parents of merged nodes form the next layer. The serial FIFO shrink also
+  // drains a layer before the next, so the merged tree is the same.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::shrink_tree_parallel()
+  {
+    vector<OctreeNode *> candidates;
+    candidates.reserve(m_queue.size());
+    while (!m_queue.empty())
+    {
+      candidates.push_back(m_queue.front());
+      m_queue.pop();
+    }
+    cout << "[OctreeSMC] Shrink start, initial queue=" << candidates.size() << ", threads=" << m_numThreads << endl;
+
+    long long popped = 0;
+    long long merged = 0;
+    vector<char> mergedFlags;
+    vector<OctreeNode *> next;
+    vector<thread> workers;
+    while (!candidates.empty())
+    {
+      size_t n = candidates.size();
+      for (size_t i = 0; i < n; ++i)
+        candidates[i]->visited = false;
+      mergedFlags.assign(n, 0);
+
+      size_t nThreads = static_cast<size_t>(m_numThreads);
+      if (nThreads > n)
+        nThreads = n;
+      workers.clear();
+      for (size_t t = 0; t < nThreads; ++t)
+      {
+        size_t begin = n * t / nThreads;
+        size_t end = n * (t + 1) / nThreads;
+        workers.push_back(thread(&CFieldOctreeSMC<TField>::merge_candidates, this,
+                                 std::cref(candidates), begin, end, std::ref(mergedFlags)));
+      }
+      for (size_t t = 0; t < workers.size(); ++t)
+        workers[t].join();
+
+      next.clear();
+      for (size_t i = 0; i < n; ++i)
+      {
+        if (!mergedFlags[i])
+          continue;
+        merged++;
+        OctreeNode *node = candidates[i];
+        if (node->parent != kNullNode && !m_nodes[node->parent].visited)
+        {
+          m_nodes[node->parent].visited = true;
+          next.push_back(&m_nodes[node->parent]);
+        }
+      }
+      popped += static_cast<long long>(n);
+      cout << "[OctreeSMC] Shrink progress popped=" << popped << ", merged=" << merged
+           << ", next layer=" << next.size() << endl;
+      candidates.swap(next);
+    }
+    cout << "[OctreeSMC] Shrink done, popped=" << popped << ", merged=" << merged << endl;
+  }
+
+  // Bottom-up merge over the Morton-sorted leaves. Siblings of a layer-k parent
+  // form a contiguous run sharing anchor >> 3k; the run merges when every entry
+  // is a layer k-1 leaf and can_merge_parms holds. The FIFO shrink of the
+  // pointer tree also finishes each layer before the next, so both agree.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::shrink_tree_linear()
+  {
+    std::sort(m_linearLeaves.begin(), m_linearLeaves.end(),
+              [](const LinearNode &a, const LinearNode &b) { return a.anchor < b.anchor; });
+    cout << "[OctreeSMC] Shrink (linear) start, leaves=" << m_linearLeaves.size() << endl;
+    long long merged = 0;
+    vector<LinearNode> next;
+    for (int layer = 1; layer <= m_maxDepth; ++layer)
+    {
+      int shift = 3 * layer;
+      long long mergedInLayer = 0;
+      next.clear();
+      next.reserve(m_linearLeaves.size());
+      size_t n = m_linearLeaves.size();
+      size_t i = 0;
+      while (i < n)
+      {
+        unsigned long long parentKey = m_linearLeaves[i].anchor >> shift;
+        size_t j = i;
+        bool allChildren = true;
+        const NodeParms *children[8] = {NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL};
+        while (j < n && (m_linearLeaves[j].anchor >> shift) == parentKey)
+        {
+          const LinearNode &c = m_linearLeaves[j];
+          if (c.layerIndex != layer - 1)
+            allChildren = false;
+          else
+            children[(c.anchor >> (shift - 3)) & 7] = &c.parms;
+          ++j;
+        }
+        int D = INT_MIN;
+        if (allChildren && can_merge_parms(children, D))
+        {
+          LinearNode parent;
+          parent.anchor = parentKey << shift;
+          parent.parms.valid = true;
+          parent.parms.config = calculate_config(children);
+          parent.parms.d = D;
+          parent.layerIndex = static_cast<unsigned char>(layer);
+          next.push_back(parent);
+          mergedInLayer++;
+        }
+        else
+        {
+          next.insert(next.end(), m_linearLeaves.begin() + i, m_linearLeaves.begin() + j);
+        }
+        i = j;
+      }
+      m_linearLeaves.swap(next);
+      merged += mergedInLayer;
+      if (mergedInLayer == 0)
+        break;
+    }
+    cout << "[OctreeSMC] Shrink (linear) done, merged=" << merged << ", leaves=" << m_linearLeaves.size() << endl;
+  }
+
+  // Shared output vertex for a grid feature key; the point is only used when
+  // the vertex is created
+  template <typename TField>
+  inline unsigned int CFieldOctreeSMC<TField>::get_vertex(unsigned long long key, const CPoint &p, ExtractOutput &out) const
+  {
+    unsigned int &slot = out.vmap[key];
+    if (slot == 0)
+      slot = new_vertex(key, p, out) + 1;
+    return slot - 1;
+  }
+
+  // Append an output vertex; key is only recorded here, get_vertex does the
+  // sharing through the vertex map
+  template <typename TField>
+  inline unsigned int CFieldOctreeSMC<TField>::new_vertex(unsigned long long key, const CPoint &p, ExtractOutput &out) const
+  {
+    out.points.push_back(p);
+    out.keys.push_back(key);
+    CPoint normal;
+    if (m_gradientFunc)
+    {
+      normal = m_gradientFunc(p);
+      double len = normal.norm();
+      if (len > 0)
+        normal /= len;
+    }
+    out.normals.push_back(normal);
+    return static_cast<unsigned int>(out.points.size() - 1);
+  }
+
+  // Append a triangle that passes can_add_face (which may flip it)
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::emit_triangle(unsigned int tri[3], ExtractOutput &out) const
+  {
+    if (!out.local && !can_add_face(tri, 3, out.edgeUse))
       return;
+    out.indices.insert(out.indices.end(), tri, tri + 3);
+  }
 
-    CPoint corners[8];
-    for (int k = 0; k < 8; ++k)
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::can_add_face(unsigned int *verts, int n, EdgeUseMap &edgeUse) const
+  {
+    if (n < 3)
+      return false;
+    // Check degenerate triangle (duplicate vertices)
+    for (int i = 0; i < n; ++i)
     {
-      double gx = node->range.xmin + kCornerOffset[k][0];
-      double gy = node->range.ymin + kCornerOffset[k][1];
-      double gz = node->range.zmin + kCornerOffset[k][2];
-      corners[k] = grid_to_world(gx, gy, gz);
+      int a = static_cast<int>(verts[i]);
+      int b = static_cast<int>(verts[(i + 1) % n]);
+      if (a == b)
+        return false;
     }
-    CPoint edgePts[12];
-    for (int e = 0; e < 12; ++e)
+
+    bool needFlip = false;
+    for (int i = 0; i < n; ++i)
     {
-      int a = kEdgeCorners[e][0];
-      int b = kEdgeCorners[e][1];
-      edgePts[e] = intersect_edge(corners[a], corners[b]);  // Precise intersection
+      int a = static_cast<int>(verts[i]);
+      int b = static_cast<int>(verts[(i + 1) % n]);
+      unsigned char *u = edgeUse.find(edge_use_key(a, b));
+      if (u == NULL)
+        continue;
+      // Manifold condition: each edge shared by at most 2 faces
+      if ((*u & 3) >= 2)
+        return false;
+      // Detect direction conflicts and flip if needed
+      if (*u & edge_use_dir_bit(a, b))
+        needFlip = true;
+    }
+    if (needFlip)
+    {
+      reverse(verts + 1, verts + n);
+      // Re-check direction conflicts after flipping
+      for (int i = 0; i < n; ++i)
+      {
+        int a = static_cast<int>(verts[i]);
+        int b = static_cast<int>(verts[(i + 1) % n]);
+        unsigned char *u = edgeUse.find(edge_use_key(a, b));
+        if (u != NULL && (*u & edge_use_dir_bit(a, b)))
+          return false;  // Direction conflict remains
+      }
     }
-    int cx = node->range.xmin;
-    int cy = node->range.ymin;
-    int cz = node->range.zmin;
 
-    for (int i = 0; kTriTable[cfg][i] != -1; i += 3)
+    // Record edge usage
+    for (int i = 0; i < n; ++i)
     {
-      CPoint p0 = edgePts[kTriTable[cfg][i]];
-      CPoint p1 = edgePts[kTriTable[cfg][i + 1]];
-      CPoint p2 = edgePts[kTriTable[cfg][i + 2]];
-      CPoint n = (p1 - p0) ^ (p2 - p0);
-      if (n.norm() <= 1e-10)
+      int a = static_cast<int>(verts[i]);
+      int b = static_cast<int>(verts[(i + 1) % n]);
+      unsigned char &u = edgeUse[edge_use_key(a, b)];
+      u = static_cast<unsigned char>(((u & 3) + 1) | (u & 12) | edge_use_dir_bit(a, b));
+    }
+    return true;
+  }
+
+  // Directed boundary segments of the leaf cube of the given size at lo,
+  // through the crossed unit grid edges of its faces, wound counter-clockwise
+  // seen from the outside of the field like the MC triangles. False when they
+  // do not close into simple loops (not a single-plane leaf after all); the
+  // result only depends on the corner states.
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::trace_leaf_boundary(const int lo[3], int size, vector<LeafFaceEdge> &edges) const
+  {
+    // Square corners (u, v) and the corner each square edge starts from
+    static const int kSquareCorner[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    static const int kSquareEdgeStart[4] = {0, 1, 3, 0};
+    static const double kSquareEdgeMid[4][2] = {{0.5, 0.0}, {1.0, 0.5}, {0.5, 1.0}, {0.0, 0.5}};
+
+    int hi[3] = {lo[0] + size, lo[1] + size, lo[2] + size};
+    edges.clear();
+    CKeyIndex<unsigned int> edgeIndex;
+    bool consistent = true;
+    auto edge_at = [&](const int g[3], int axis) -> unsigned int
+    {
+      unsigned int &slot = edgeIndex[edge_vertex_key(g[0], g[1], g[2], axis)];
+      if (slot == 0)
+      {
+        LeafFaceEdge e = {{g[0], g[1], g[2]}, axis, kNullNode, false};
+        edges.push_back(e);
+        slot = static_cast<unsigned int>(edges.size());
+      }
+      return slot - 1;
+    };
+
+    for (int f = 0; f < 6; ++f)
+    {
+      int a = f >> 1;
+      int u = (a + 1) % 3;
+      int v = (a + 2) % 3;
+      double sign = (f & 1) ? 1.0 : -1.0;
+      int g[3];
+      g[a] = (f & 1) ? hi[a] : lo[a];
+      for (int j = 0; j < size; ++j)
+      {
+        for (int i = 0; i < size; ++i)
+        {
+          int c[4][3];
+          signed char st[4];
+          for (int k = 0; k < 4; ++k)
+          {
+            c[k][a] = g[a];
+            c[k][u] = lo[u] + i + kSquareCorner[k][0];
+            c[k][v] = lo[v] + j + kSquareCorner[k][1];
+            st[k] = sampled_point_state(c[k][0], c[k][1], c[k][2]);
+          }
+          if (st[0] == st[1] && st[1] == st[2] && st[2] == st[3])
+            continue;
+          int crossed[4];
+          int nc = 0;
+          for (int k = 0; k < 4; ++k)
+          {
+            int k1 = (k + 1) & 3;
+            if (st[k] >= 0 && st[k1] >= 0 && st[k] != st[k1])
+              crossed[nc++] = k;
+          }
+          // Pairs of square edges and the in-face direction from the inside
+          // to the outside of the field; the ambiguous square cuts off its
+          // inside corners
+          int pairs[2][2];
+          double dirs[2][2];
+          int np = 0;
+          if (nc == 2)
+          {
+            pairs[0][0] = crossed[0];
+            pairs[0][1] = crossed[1];
+            dirs[0][0] = dirs[0][1] = 0;
+            for (int k = 0; k < 4; ++k)
+            {
+              double w = st[k] == 0 ? 1.0 : -1.0;
+              dirs[0][0] += w * (kSquareCorner[k][0] - 0.5);
+              dirs[0][1] += w * (kSquareCorner[k][1] - 0.5);
+            }
+            np = 1;
+          }
+          else if (nc == 4)
+          {
+            for (int k = 0; k < 4; ++k)
+            {
+              if (st[k] != 1)
+                continue;
+              pairs[np][0] = (k + 3) & 3;
+              pairs[np][1] = k;
+              dirs[np][0] = 0.5 - kSquareCorner[k][0];
+              dirs[np][1] = 0.5 - kSquareCorner[k][1];
+              np++;
+            }
+          }
+          for (int p = 0; p < np; ++p)
+          {
+            int e0 = pairs[p][0];
+            int e1 = pairs[p][1];
+            // Boundary direction = outward field direction x outward face normal
+            double du = sign * dirs[p][1];
+            double dv = -sign * dirs[p][0];
+            if ((kSquareEdgeMid[e1][0] - kSquareEdgeMid[e0][0]) * du + (kSquareEdgeMid[e1][1] - kSquareEdgeMid[e0][1]) * dv < 0)
+              std::swap(e0, e1);
+            int axis0 = (e0 & 1) ? v : u;
+            int axis1 = (e1 & 1) ? v : u;
+            unsigned int from = edge_at(c[kSquareEdgeStart[e0]], axis0);
+            unsigned int to = edge_at(c[kSquareEdgeStart[e1]], axis1);
+            if (edges[from].next != kNullNode)
+              consistent = false;
+            edges[from].next = to;
+          }
+        }
+      }
+    }
+    for (size_t i = 0; i < edges.size(); ++i)
+      if (edges[i].next == kNullNode)
+        consistent = false;
+    return consistent;
+  }
+
+  // Adaptive output of a merged planar leaf. The surface is traced around the
+  // leaf boundary through the crossed unit grid edges, whose vertices are the
+  // ones finer MC cells create there too, and each loop is emitted as one
+  // polygon. A face shared with a same-size leaf that traces as well (and so
+  // emits a polygon with the same crossings on the shared face's edges) or
+  // lying on the domain boundary keeps only the crossings on the leaf edges;
+  // every other face keeps its whole chain, so T-junctions against finer,
+  // coarser or per-cell neighbours are stitched.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::generate_face(const BoxRange &range, ExtractOutput &out) const
+  {
+    int size = range.xmax - range.xmin + 1;
+    int layer = 0;
+    while ((1 << layer) < size)
+      ++layer;
+    int lo[3] = {range.xmin, range.ymin, range.zmin};
+    int hi[3] = {range.xmin + size, range.ymin + size, range.zmin + size};
+
+    vector<LeafFaceEdge> edges;
+    if (!trace_leaf_boundary(lo, size, edges))
+    {
+      // Per-cell MC; the neighbours find this leaf in m_untracedLeaves and
+      // keep their chains on the shared face
+      extract_range(range, out);
+      return;
+    }
+
+    bool dropFace[6];
+    for (int f = 0; f < 6; ++f)
+    {
+      int n[3] = {lo[0], lo[1], lo[2]};
+      n[f >> 1] += (f & 1) ? size : -size;
+      if (n[f >> 1] < 0 || n[f >> 1] >= m_scale)
+        dropFace[f] = true;
+      else
+        dropFace[f] = is_leaf_at(n[0], n[1], n[2], layer) &&
+                      m_untracedLeaves.count(osmc_morton_encode(n[0], n[1], n[2]) * (kMaxSparseDepth + 1) + layer) == 0;
+    }
+
+    vector<unsigned int> loop;
+    vector<CPoint> pts;
+    for (size_t start = 0; start < edges.size(); ++start)
+    {
+      if (edges[start].visited)
         continue;
-      // Use gradient at triangle center to orient normal
-      CPoint triCenter = (p0 + p1 + p2) / 3.0;
-      CPoint grad = gradient(triCenter);
-      // Gradient is the isosurface normal (inside -> outside); align triangle normal with it
-      if ((n * grad) < 0)
+      loop.clear();
+      for (unsigned int e = static_cast<unsigned int>(start); !edges[e].visited; e = edges[e].next)
       {
-        CPoint t = p1;
-        p1 = p2;
-        p2 = t;
+        LeafFaceEdge &fe = edges[e];
+        fe.visited = true;
+        int p = (fe.axis + 1) % 3;
+        int q = (fe.axis + 2) % 3;
+        int sideP = fe.g[p] == lo[p] ? 0 : (fe.g[p] == hi[p] ? 1 : -1);
+        int sideQ = fe.g[q] == lo[q] ? 0 : (fe.g[q] == hi[q] ? 1 : -1);
+        bool keep = true;
+        if (sideP < 0)
+          keep = !dropFace[2 * q + sideQ];
+        else if (sideQ < 0)
+          keep = !dropFace[2 * p + sideP];
+        if (!keep)
+          continue;
+        unsigned int vert = edge_crossing_vertex(fe.g[0], fe.g[1], fe.g[2], fe.axis, out);
+        if (loop.empty() || loop.back() != vert)
+          loop.push_back(vert);
+      }
+      while (loop.size() > 1 && loop.back() == loop.front())
+        loop.pop_back();
+      size_t m = loop.size();
+      if (m < 3)
+        continue;
+
+      // Fan from a vertex when the polygon is strictly convex, otherwise
+      // (collinear chain vertices) from an added centroid vertex
+      pts.resize(m);
+      CPoint centroid;
+      CPoint normal;
+      for (size_t i = 0; i < m; ++i)
+      {
+        pts[i] = out.points[loop[i]];
+        centroid += pts[i];
+      }
+      centroid /= static_cast<double>(m);
+      for (size_t i = 0; i < m; ++i)
+        normal += (pts[i] - centroid) ^ (pts[(i + 1) % m] - centroid);
+      bool convex = true;
+      for (size_t i = 0; i < m && convex; ++i)
+      {
+        CPoint d0 = pts[i] - pts[(i + m - 1) % m];
+        CPoint d1 = pts[(i + 1) % m] - pts[i];
+        convex = ((d0 ^ d1) * normal) > 1e-6 * d0.norm() * d1.norm() * normal.norm();
+      }
+      unsigned int apex = loop[0];
+      size_t first = 1;
+      size_t last = m - 1;
+      if (!convex)
+      {
+        apex = new_vertex(kUnsharedVertexKey, centroid, out);
+        first = 0;
+        last = m;
+      }
+      for (size_t i = first; i < last; ++i)
+      {
+        unsigned int tri[3] = {apex, loop[i], loop[(i + 1) % m]};
+        CPoint n = (out.points[tri[1]] - out.points[tri[0]]) ^ (out.points[tri[2]] - out.points[tri[0]]);
+        if (n.norm() <= 1e-10)
+          continue;
+        emit_triangle(tri, out);
       }
-      vector<CTMesh::CVertex *> tri;
-      tri.push_back(get_vertex(p0, out, vid, vmap, quant));
-      tri.push_back(get_vertex(p1, out, vid, vmap, quant));
-      tri.push_back(get_vertex(p2, out, vid, vmap, quant));
-      if (can_add_face(tri, edgeUse, dirEdgeUse))
-        out->createFace(tri, fid++);
     }
   }
 
-  inline void COctreeSMC::generate_cell_mc(int x, int y, int z, unsigned char cfg, CTMesh *out, int &vid, int &fid,
-                                       map<VertKey, CTMesh::CVertex *> &vmap,
-                                       map<EdgeKey, int> &edgeUse,
-                                       map<EdgeKey, int> &dirEdgeUse,
-                                       double quant) const
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::generate_cell_mc(int x, int y, int z, unsigned char cfg, ExtractOutput &out) const
   {
     unsigned char mcCfg = remap_cfg_to_mc(cfg);
     if (mcCfg == 0 || mcCfg == 255)
       return;
 
-    CPoint corners[8];
-    for (int k = 0; k < 8; ++k)
-    {
-      double gx = x + kCornerOffset[k][0];
-      double gy = y + kCornerOffset[k][1];
-      double gz = z + kCornerOffset[k][2];
-      corners[k] = grid_to_world(gx, gy, gz);
-    }
+    // Crossings already emitted by a neighbouring cell are taken from the
+    // vertex map, which also holds an entry per grid edge (edge key -> vertex);
+    // the corners are only sampled when some used edge is not cached yet
     CPoint edgePts[12];
+    unsigned long long edgeKeys[12];
+    unsigned long long vertKeys[12];
+    unsigned int edgeVerts[12];
+    bool used[12] = {false, false, false, false, false, false, false, false, false, false, false, false};
+    bool needSamples = false;
+    for (int i = 0; kTriTable[mcCfg][i] != -1; ++i)
+      used[kTriTable[mcCfg][i]] = true;
     for (int e = 0; e < 12; ++e)
     {
+      edgeVerts[e] = kNullNode;
+      if (!used[e])
+        continue;
       int a = kEdgeCorners[e][0];
       int b = kEdgeCorners[e][1];
-      edgePts[e] = intersect_edge(corners[a], corners[b]);  // Precise intersection
+      int axis = kCornerOffset[a][0] != kCornerOffset[b][0] ? 0 : (kCornerOffset[a][1] != kCornerOffset[b][1] ? 1 : 2);
+      if (kCornerOffset[a][axis] > kCornerOffset[b][axis])
+        a = b;
+      edgeKeys[e] = edge_vertex_key(x + kCornerOffset[a][0], y + kCornerOffset[a][1], z + kCornerOffset[a][2], axis);
+      unsigned int *cached = out.vmap.find(edgeKeys[e]);
+      if (cached != NULL)
+      {
+        edgeVerts[e] = *cached - 1;
+        edgePts[e] = out.points[edgeVerts[e]];
+        vertKeys[e] = edgeKeys[e];
+      }
+      else
+        needSamples = true;
+    }
+
+    if (needSamples)
+    {
+      CPoint corners[8];
+      for (int k = 0; k < 8; ++k)
+      {
+        double gx = x + kCornerOffset[k][0];
+        double gy = y + kCornerOffset[k][1];
+        double gz = z + kCornerOffset[k][2];
+        corners[k] = grid_to_world(gx, gy, gz);
+      }
+      double values[8];
+      if (!load_corner_values(x, y, z, values))
+        sample_corners(corners, values);
+      for (int e = 0; e < 12; ++e)
+      {
+        if (!used[e] || edgeVerts[e] != kNullNode)
+          continue;
+        // Walk every edge in the positive axis direction so that neighbouring
+        // cells compute the same crossing for a shared edge
+        int a = kEdgeCorners[e][0];
+        int b = kEdgeCorners[e][1];
+        int axis = kCornerOffset[a][0] != kCornerOffset[b][0] ? 0 : (kCornerOffset[a][1] != kCornerOffset[b][1] ? 1 : 2);
+        if (kCornerOffset[a][axis] > kCornerOffset[b][axis])
+          std::swap(a, b);
+        double t = edge_crossing(values[a], values[b]);  // Precise intersection
+        edgePts[e] = corners[a] + (corners[b] - corners[a]) * t;
+        // A crossing clamped onto a grid point is shared by all edges meeting there
+        int c = a;
+        if (t >= 1.0)
+        {
+          c = b;
+          axis = 3;
+        }
+        else if (t <= 0.0)
+          axis = 3;
+        vertKeys[e] = edge_vertex_key(x + kCornerOffset[c][0], y + kCornerOffset[c][1], z + kCornerOffset[c][2], axis);
+      }
     }
 
     for (int i = 0; kTriTable[mcCfg][i] != -1; i += 3)
     {
+      int e0 = kTriTable[mcCfg][i];
+      int e1 = kTriTable[mcCfg][i + 1];
+      int e2 = kTriTable[mcCfg][i + 2];
       CPoint p0 = edgePts[kTriTable[mcCfg][i]];
       CPoint p1 = edgePts[kTriTable[mcCfg][i + 1]];
       CPoint p2 = edgePts[kTriTable[mcCfg][i + 2]];
       CPoint n = (p1 - p0) ^ (p2 - p0);
       if (n.norm() <= 1e-10)
         continue;
-      // Use gradient at triangle center to orient normal
-      CPoint triCenter = (p0 + p1 + p2) / 3.0;
-      CPoint grad = gradient(triCenter);
-      // Gradient is the isosurface normal (inside -> outside); align triangle normal with it
-      if ((n * grad) < 0)
+      // The remapped MC table already winds triangles with the normal pointing
+      // from inside to outside; a user gradient can still override it
+      if (m_gradientFunc)
+      {
+        CPoint grad = m_gradientFunc((p0 + p1 + p2) / 3.0);
+        if ((n * grad) < 0)
+          std::swap(e1, e2);
+      }
+      int tv[3] = {e0, e1, e2};
+      unsigned int tri[3];
+      for (int k = 0; k < 3; ++k)
+      {
+        int e = tv[k];
+        if (edgeVerts[e] == kNullNode)
+        {
+          edgeVerts[e] = get_vertex(vertKeys[e], edgePts[e], out);
+          if (vertKeys[e] != edgeKeys[e])
+            out.vmap[edgeKeys[e]] = edgeVerts[e] + 1;
+        }
+        tri[k] = edgeVerts[e];
+      }
+      emit_triangle(tri, out);
+    }
+  }
+
+  // Output vertex of the crossing on the unit grid edge from (gx, gy, gz)
+  // along axis, computed and keyed as in generate_cell_mc
+  template <typename TField>
+  inline unsigned int CFieldOctreeSMC<TField>::edge_crossing_vertex(int gx, int gy, int gz, int axis, ExtractOutput &out) const
+  {
+    unsigned long long edgeKey = edge_vertex_key(gx, gy, gz, axis);
+    unsigned int *cached = out.vmap.find(edgeKey);
+    if (cached != NULL)
+      return *cached - 1;
+    int g1[3] = {gx, gy, gz};
+    g1[axis]++;
+    CPoint p0 = grid_to_world(gx, gy, gz);
+    CPoint p1 = grid_to_world(g1[0], g1[1], g1[2]);
+    double values[2];
+    if (!load_point_value(gx, gy, gz, values[0]) || !load_point_value(g1[0], g1[1], g1[2], values[1]))
+    {
+      double xs[2] = {p0[0], p1[0]};
+      double ys[2] = {p0[1], p1[1]};
+      double zs[2] = {p0[2], p1[2]};
+      sample_batch(xs, ys, zs, values, 2);
+    }
+    double t = edge_crossing(values[0], values[1]);
+    unsigned long long vertKey = edgeKey;
+    if (t >= 1.0)
+      vertKey = edge_vertex_key(g1[0], g1[1], g1[2], 3);
+    else if (t <= 0.0)
+      vertKey = edge_vertex_key(gx, gy, gz, 3);
+    unsigned int vert = get_vertex(vertKey, p0 + (p1 - p0) * t, out);
+    if (vertKey != edgeKey)
+      out.vmap[edgeKey] = vert + 1;
+    return vert;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::finish_vertex_normals(ExtractOutput &out) const
+  {
+    if (m_gradientFunc)
+      return;
+    // Area-weighted face normals, summed in triangle order
+    for (size_t t = 0; t + 2 < out.indices.size(); t += 3)
+    {
+      const unsigned int *tri = &out.indices[t];
+      const CPoint &p0 = out.points[tri[0]];
+      CPoint fn = (out.points[tri[1]] - p0) ^ (out.points[tri[2]] - p0);
+      for (int k = 0; k < 3; ++k)
+        out.normals[tri[k]] += fn;
+    }
+    for (size_t i = 0; i < out.normals.size(); ++i)
+    {
+      double len = out.normals[i].norm();
+      if (len > 0)
+        out.normals[i] /= len;
+    }
+  }
+
+  // Per-cell MC over the boundary cells of a leaf range (a Morton-aligned cube),
+  // read as one run of the sorted boundary list instead of a volume sweep
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::extract_range(const BoxRange &range, ExtractOutput &out) const
+  {
+    unsigned long long size = static_cast<unsigned long long>(range.xmax - range.xmin + 1);
+    MortonCell first;
+    first.code = osmc_morton_encode(range.xmin, range.ymin, range.zmin);
+    unsigned long long end = first.code + size * size * size;
+    typename vector<MortonCell>::const_iterator it = std::lower_bound(m_boundaryCells.begin(), m_boundaryCells.end(), first, morton_cell_order);
+    for (; it != m_boundaryCells.end() && it->code < end; ++it)
+    {
+      int x = static_cast<int>(osmc_compact_bits3(it->code));
+      int y = static_cast<int>(osmc_compact_bits3(it->code >> 1));
+      int z = static_cast<int>(osmc_compact_bits3(it->code >> 2));
+      generate_cell_mc(x, y, z, it->config, out);
+    }
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::extract_leaf(const BoxRange &range, ExtractOutput &out) const
+  {
+    if (m_adaptive && range.xmax > range.xmin)
+      generate_face(range, out);
+    else
+      extract_range(range, out);
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::extract_leaves(const vector<BoxRange> &leaves, size_t begin, size_t end, ExtractOutput &out) const
+  {
+    for (size_t i = begin; i < end; ++i)
+      extract_leaf(leaves[i], out);
+  }
+
+  // Leaf-parallel extraction: workers extract contiguous runs of the leaf order
+  // (balanced by the cells they scan) into local outputs, which are merged in
+  // run order so vertices and faces come out exactly as in a serial extraction.
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::extract_leaves_parallel(const vector<BoxRange> &leaves, ExtractOutput &out) const
+  {
+    size_t nThreads = static_cast<size_t>(m_numThreads);
+    if (nThreads > leaves.size())
+      nThreads = leaves.size();
+
+    vector<long long> cost(leaves.size() + 1, 0);
+    for (size_t i = 0; i < leaves.size(); ++i)
+    {
+      long long size = leaves[i].xmax - leaves[i].xmin + 1;
+      long long cells = (m_adaptive && size > 1) ? 6 * size * size : size * size * size;
+      cost[i + 1] = cost[i] + cells;
+    }
+    vector<size_t> runBegin(nThreads + 1);
+    for (size_t t = 0; t < nThreads; ++t)
+      runBegin[t] = std::lower_bound(cost.begin(), cost.end(), cost.back() * static_cast<long long>(t) / static_cast<long long>(nThreads)) - cost.begin();
+    runBegin[nThreads] = leaves.size();
+
+    vector<ExtractOutput> parts(nThreads);
+    vector<thread> workers;
+    for (size_t t = 0; t < nThreads; ++t)
+    {
+      parts[t].local = true;
+      workers.push_back(thread(&CFieldOctreeSMC<TField>::extract_leaves, this, std::cref(leaves),
+                               runBegin[t], runBegin[t + 1], std::ref(parts[t])));
+    }
+    for (size_t t = 0; t < workers.size(); ++t)
+      workers[t].join();
+
+    for (size_t t = 0; t < nThreads; ++t)
+    {
+      merge_extract_output(parts[t], out);
+      parts[t] = ExtractOutput();
+    }
+    cout << "[OctreeSMC] Extract merged, threads=" << nThreads << endl;
+  }
+
+  // Append a worker's output: each keyed vertex takes the index of its first
+  // occurrence in run order and the faces replay can_add_face in order, which
+  // is the numbering and orientation the serial extraction produces
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::merge_extract_output(const ExtractOutput &part, ExtractOutput &out) const
+  {
+    vector<unsigned int> remap(part.points.size());
+    for (size_t i = 0; i < part.points.size(); ++i)
+    {
+      unsigned long long key = part.keys[i];
+      if (key != kUnsharedVertexKey)
       {
-        CPoint t = p1;
-        p1 = p2;
-        p2 = t;
+        unsigned int &slot = out.vmap[key];
+        if (slot != 0)
+        {
+          remap[i] = slot - 1;
+          continue;
+        }
+        slot = static_cast<unsigned int>(out.points.size()) + 1;
       }
-      vector<CTMesh::CVertex *> tri;
-      tri.push_back(get_vertex(p0, out, vid, vmap, quant));
-      tri.push_back(get_vertex(p1, out, vid, vmap, quant));
-      tri.push_back(get_vertex(p2, out, vid, vmap, quant));
-      if (can_add_face(tri, edgeUse, dirEdgeUse))
-        out->createFace(tri, fid++);
+      remap[i] = static_cast<unsigned int>(out.points.size());
+      out.points.push_back(part.points[i]);
+      out.normals.push_back(part.normals[i]);
+      out.keys.push_back(key);
+    }
+    for (size_t t = 0; t + 2 < part.indices.size(); t += 3)
+    {
+      unsigned int tri[3] = {remap[part.indices[t]], remap[part.indices[t + 1]], remap[part.indices[t + 2]]};
+      emit_triangle(tri, out);
     }
   }
 
-  inline CTMesh *COctreeSMC::gen_mesh()
+  // Whether the node of the given layer whose minimum cell is (x, y, z) is a leaf
+  template <typename TField>
+  inline bool CFieldOctreeSMC<TField>::is_leaf_at(int x, int y, int z, int layer) const
+  {
+    if (m_linear)
+    {
+      // The leaves are in linear_extract_order during extraction
+      LinearNode key;
+      key.anchor = osmc_morton_encode(x, y, z);
+      key.layerIndex = static_cast<unsigned char>(layer);
+      typename vector<LinearNode>::const_iterator it = std::lower_bound(m_linearLeaves.begin(), m_linearLeaves.end(), key, linear_extract_order);
+      return it != m_linearLeaves.end() && it->anchor == key.anchor && it->layerIndex == key.layerIndex;
+    }
+    const OctreeNode *node = m_root;
+    for (int l = m_maxDepth; l > layer; --l)
+    {
+      if (node->is_leaf())
+        return false;
+      unsigned int child = node->children[get_index_on(x, y, z, l - 1)];
+      if (child == kNullNode)
+        return false;
+      node = &m_nodes[child];
+    }
+    return node->is_leaf();
+  }
+
+  // Construct, shrink and extract; records the stage timings except the
+  // output conversion done by the caller
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::extract_surface(ExtractOutput &out)
   {
     using Clock = std::chrono::steady_clock;
-    auto tStart = Clock::now();
 
-    CTMesh *out = new CTMesh();
-    int vid = 1;
-    int fid = 1;
-
-    if (m_root != NULL)
-      delete m_root;
-    m_root = new OctreeNode();
-    m_root->range.xmin = 0;
-    m_root->range.ymin = 0;
-    m_root->range.zmin = 0;
-    m_root->range.xmax = m_scale - 1;
-    m_root->range.ymax = m_scale - 1;
-    m_root->range.zmax = m_scale - 1;
-    m_root->layerIndex = m_maxDepth;
+    // Release the previous tree in bulk
+    m_nodes.reset();
+    m_root = &m_nodes[m_nodes.allocate()];
+    m_root->layerIndex = static_cast<unsigned char>(m_maxDepth);
 
     while (!m_queue.empty())
       m_queue.pop();
+    m_linearLeaves.clear();
+    m_boundaryCells.clear();
 
     auto t0 = Clock::now();
     construct_tree();
+    std::sort(m_boundaryCells.begin(), m_boundaryCells.end(), morton_cell_order);
     auto t1 = Clock::now();
-    shrink_tree();
+    if (m_linear)
+      shrink_tree_linear();
+    else
+    {
+      cout << "[OctreeSMC] Node pool nodes=" << m_nodes.size() << ", node bytes=" << sizeof(OctreeNode)
+           << ", pool MB=" << (m_nodes.capacity_bytes() >> 20) << endl;
+      if (m_numThreads > 1)
+        shrink_tree_parallel();
+      else
+        shrink_tree();
+    }
     auto t2 = Clock::now();
+    long long constructSamples = m_sampleCount;
 
-    map<VertKey, CTMesh::CVertex *> vmap;
-    map<EdgeKey, int> edgeUse;
-    map<EdgeKey, int> dirEdgeUse;
-    double quant = 1e10;  // Higher quantization precision to reduce vertex mismatch from floating errors
-
+    // Collect the leaves in extraction order; vertex and face numbering
+    // follow it, with or without worker threads
+    vector<BoxRange> leaves;
     queue<OctreeNode *> bfs;
-    bfs.push(m_root);
+    if (!m_linear)
+      bfs.push(m_root);
     long long visitedNodes = 0;
-    long long visitedLeaves = 0;
-    cout << "[OctreeSMC] Extract start" << endl;
+    long long mergedLeaves = 0;
+    cout << "[OctreeSMC] Extract start" << (m_adaptive ? ", adaptive" : "") << endl;
+    if (m_linear)
+    {
+      // Scan the leaves coarsest layer first and in Morton order within a
+      // layer, which is the breadth-first order of the pointer tree
+      std::sort(m_linearLeaves.begin(), m_linearLeaves.end(), linear_extract_order);
+      leaves.reserve(m_linearLeaves.size());
+      for (size_t i = 0; i < m_linearLeaves.size(); ++i)
+      {
+        const LinearNode &leaf = m_linearLeaves[i];
+        int size = 1 << leaf.layerIndex;
+        BoxRange range;
+        range.xmin = static_cast<int>(osmc_compact_bits3(leaf.anchor));
+        range.ymin = static_cast<int>(osmc_compact_bits3(leaf.anchor >> 1));
+        range.zmin = static_cast<int>(osmc_compact_bits3(leaf.anchor >> 2));
+        range.xmax = range.xmin + size - 1;
+        range.ymax = range.ymin + size - 1;
+        range.zmax = range.zmin + size - 1;
+        leaves.push_back(range);
+      }
+      visitedNodes = static_cast<long long>(m_linearLeaves.size());
+    }
     while (!bfs.empty())
     {
       OctreeNode *node = bfs.front();
       bfs.pop();
       visitedNodes++;
       if (node->is_leaf())
-      {
-        visitedLeaves++;
-        int zmin = node->range.zmin;
-        int zmax = node->range.zmax;
-        int ymin = node->range.ymin;
-        int ymax = node->range.ymax;
-        int xmin = node->range.xmin;
-        int xmax = node->range.xmax;
-        for (int z = zmin; z <= zmax; ++z)
-        {
-          for (int y = ymin; y <= ymax; ++y)
-          {
-            for (int x = xmin; x <= xmax; ++x)
-            {
-              unsigned char cfg = cell_config(x, y, z);
-              if (cfg == 0 || cfg == 255)
-                continue;
-              generate_cell_mc(x, y, z, cfg, out, vid, fid, vmap, edgeUse, dirEdgeUse, quant);
-            }
-          }
-        }
-      }
+        leaves.push_back(node_range(node));
       else
       {
         for (int i = 0; i < 8; ++i)
-          if (node->children[i] != NULL)
-            bfs.push(node->children[i]);
+          if (node->children[i] != kNullNode)
+            bfs.push(&m_nodes[node->children[i]]);
       }
-      if ((visitedNodes % 20000) == 0)
+    }
+    long long visitedLeaves = static_cast<long long>(leaves.size());
+    m_untracedLeaves.clear();
+    if (m_adaptive)
+    {
+      // Merged leaves whose boundary does not trace fall back to per-cell MC;
+      // their neighbours must know before either side drops face crossings
+      vector<LeafFaceEdge> traceEdges;
+      for (size_t i = 0; i < leaves.size(); ++i)
       {
-        cout << "[OctreeSMC] Extract progress nodes=" << visitedNodes << ", leaves=" << visitedLeaves
-             << ", faces=" << (fid - 1) << endl;
+        int size = leaves[i].xmax - leaves[i].xmin + 1;
+        if (size == 1)
+          continue;
+        mergedLeaves++;
+        int layer = 0;
+        while ((1 << layer) < size)
+          ++layer;
+        int lo[3] = {leaves[i].xmin, leaves[i].ymin, leaves[i].zmin};
+        if (!trace_leaf_boundary(lo, size, traceEdges))
+          m_untracedLeaves.insert(osmc_morton_encode(lo[0], lo[1], lo[2]) * (kMaxSparseDepth + 1) + layer);
       }
     }
+
+    if (m_numThreads > 1 && leaves.size() > 1)
+      extract_leaves_parallel(leaves, out);
+    else
+    {
+      for (size_t i = 0; i < leaves.size(); ++i)
+      {
+        extract_leaf(leaves[i], out);
+        if (((i + 1) % 20000) == 0)
+          cout << "[OctreeSMC] Extract progress leaves=" << (i + 1) << ", faces=" << (out.indices.size() / 3) << endl;
+      }
+    }
+    finish_vertex_normals(out);
     auto t3 = Clock::now();
 
-    auto msConstruct = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
-    auto msShrink = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
-    auto msExtract = std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count();
-    auto msTotal = std::chrono::duration_cast<std::chrono::milliseconds>(t3 - tStart).count();
+    m_timing.construct = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count();
+    m_timing.shrink = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count();
+    m_timing.extract = std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count();
     cout << "[OctreeSMC] Extract done, nodes=" << visitedNodes << ", leaves=" << visitedLeaves
-         << ", faces=" << (fid - 1) << ", verts=" << (vid - 1) << endl;
-    cout << "[OctreeSMC] Timing(ms): construct=" << msConstruct
-         << ", shrink=" << msShrink
-         << ", extract=" << msExtract
-         << ", total=" << msTotal << endl;
+         << ", faces=" << (out.indices.size() / 3) << ", verts=" << out.points.size()
+         << ", field samples=" << (m_sampleCount - constructSamples);
+    if (m_adaptive)
+      cout << ", planar leaves=" << mergedLeaves;
+    cout << endl;
+  }
+
+  // Add the output conversion time to the extract stage and log all stages
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::finish_timing(std::chrono::steady_clock::time_point tStart, long long msOutput)
+  {
+    m_timing.extract += msOutput;
+    m_timing.total = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count();
+    cout << "[OctreeSMC] Timing(ms): construct=" << m_timing.construct
+         << ", shrink=" << m_timing.shrink
+         << ", extract=" << m_timing.extract
+         << ", total=" << m_timing.total << endl;
+  }
+
+  // Free the welding tables of a finished extraction, keeping the mesh arrays
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::release_lookup(ExtractOutput &out)
+  {
+    out.vmap.clear();
+    out.edgeUse.clear();
+    vector<unsigned long long>().swap(out.keys);
+  }
+
+  // Flatten points to xyz floats and free the points
+  inline void osmc_points_to_floats(vector<CPoint> &points, vector<float> &xyz)
+  {
+    xyz.resize(3 * points.size());
+    for (size_t i = 0; i < points.size(); ++i)
+      for (int k = 0; k < 3; ++k)
+        xyz[3 * i + k] = static_cast<float>(points[i][k]);
+    vector<CPoint>().swap(points);
+  }
 
+  template <typename TField>
+  inline CTMesh *CFieldOctreeSMC<TField>::gen_mesh()
+  {
+    using Clock = std::chrono::steady_clock;
+    auto tStart = Clock::now();
+    ExtractOutput surface;
+    extract_surface(surface);
+
+    auto tOutput = Clock::now();
+    release_lookup(surface);
+    CTMesh *out = new CTMesh();
+    out->build_from_indexed(surface.points, surface.indices);
+    vector<CPoint>().swap(surface.points);
+    vector<unsigned int>().swap(surface.indices);
+    size_t i = 0;
+    for (CTMesh::MeshVertexIterator viter(out); !viter.end(); ++viter)
+      (*viter)->normal() = surface.normals[i++];
+    finish_timing(tStart, std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - tOutput).count());
+    return out;
+  }
+
+  template <typename TField>
+  inline void CFieldOctreeSMC<TField>::gen_mesh(OSMCMeshBuffers &buffers)
+  {
+    using Clock = std::chrono::steady_clock;
+    auto tStart = Clock::now();
+    ExtractOutput surface;
+    extract_surface(surface);
+
+    auto tOutput = Clock::now();
+    // Free each part of the extraction as soon as it is converted, so the
+    // whole mesh is never held in both double and float precision
+    release_lookup(surface);
+    buffers.indices = std::move(surface.indices);
+    osmc_points_to_floats(surface.points, buffers.positions);
+    osmc_points_to_floats(surface.normals, buffers.normals);
+    finish_timing(tStart, std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - tOutput).count());
+  }
+
+  // Binary little endian .ply with positions, normals (when present) and triangles
+  inline bool osmc_write_ply(const OSMCMeshBuffers &buffers, const char *filename)
+  {
+    bool hasNormals = !buffers.normals.empty() && buffers.normals.size() == buffers.positions.size();
+    return write_ply_binary(filename, buffers.positions.data(), hasNormals ? buffers.normals.data() : NULL,
+                            buffers.positions.size() / 3, buffers.indices.data(), buffers.indices.size() / 3);
+  }
+
+  // Binary .stl with facet normals computed from the triangles
+  inline bool osmc_write_stl(const OSMCMeshBuffers &buffers, const char *filename)
+  {
+    return write_stl_binary(filename, buffers.positions.data(), buffers.indices.data(), buffers.indices.size() / 3);
+  }
+
+  // Memory-mapped binary .ply reader (normals stay empty if the file has none)
+  inline bool osmc_read_ply(const char *filename, OSMCMeshBuffers &buffers)
+  {
+    return read_ply_binary(filename, buffers.positions, buffers.normals, buffers.indices);
+  }
+
+  // Build a halfedge mesh from flat buffers (vertex and face ids start at 1)
+  inline CTMesh *osmc_buffers_to_mesh(const OSMCMeshBuffers &buffers)
+  {
+    CTMesh *out = new CTMesh();
+    out->build_from_indexed(buffers.positions, buffers.indices);
+    if (buffers.normals.size() == buffers.positions.size())
+    {
+      size_t i = 0;
+      for (CTMesh::MeshVertexIterator viter(out); !viter.end(); ++viter, ++i)
+        (*viter)->normal() = CPoint(buffers.normals[3 * i], buffers.normals[3 * i + 1], buffers.normals[3 * i + 2]);
+    }
     return out;
   }
 }
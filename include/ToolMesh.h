@@ -58,22 +58,16 @@ namespace MeshLib
 
 	inline void CToolVertex::_to_string()
 	{
-		std::string a;
-		m_string = a;
-
-		if (1)
+		// rgb is the only vertex trait, so the string is rebuilt without parsing
+		char buf[32];
+		m_string = "rgb=(";
+		for (int i = 0; i < 3; i++)
 		{
-			CParser parser3(m_string);
-			parser3._removeToken("rgb");
-			parser3._toString(m_string);
-			std::stringstream iss3;
-			iss3 << "rgb=(" << m_rgb[0] << " " << m_rgb[1] << " " << m_rgb[2] << ")";
-			if (m_string.length() > 0)
-			{
+			if (i > 0)
 				m_string += " ";
-			}
-			m_string += iss3.str();
+			m_string.append(buf, CFileWriter::format_double(m_rgb[i], buf));
 		}
+		m_string += ")";
 	}
 
 	class CToolEdge : public CEdge
@@ -1,6 +1,7 @@
 #ifndef _TRI_TOP_OPER_H_
 #define _TRI_TOP_OPER_H_
 
+#include <list>
 #include <vector>
 #include <map>
 using namespace std;
@@ -26,6 +27,8 @@ namespace MeshLib
 	protected:
 		void _update_vertex_edges(typename M::CVertex *pVertex);
 		void _attach_halfedge_to_edge(typename M::CHalfEdge *he0, typename M::CHalfEdge *he1, typename M::CEdge *e);
+		typename M::CEdge *_link_edge(typename M::CHalfEdge *he0, typename M::CHalfEdge *he1);
+		void _link_face(typename M::CFace *f, typename M::CHalfEdge *h0, typename M::CHalfEdge *h1, typename M::CHalfEdge *h2);
 
 	protected:
 		M *m_pMesh;
@@ -83,6 +86,33 @@ namespace MeshLib
 			he1->edge() = e;
 	}
 
+	/* new edge for one or two halfedges whose vertices are already linked */
+	template <typename M>
+	typename M::CEdge *CTriTopOper<M>::_link_edge(typename M::CHalfEdge *he0, typename M::CHalfEdge *he1)
+	{
+		M::CEdge *e = m_pMesh->allocEdge();
+		_attach_halfedge_to_edge(he0, he1, e);
+		M::CVertex *v0 = m_pMesh->halfedgeSource(he0);
+		M::CVertex *v1 = m_pMesh->halfedgeTarget(he0);
+		m_pMesh->vertexEdges(v0->id() < v1->id() ? v0 : v1).push_back(e);
+		m_pMesh->indexEdge(e);
+		return e;
+	}
+
+	/* make h0, h1, h2 the ccw halfedge loop of face f */
+	template <typename M>
+	void CTriTopOper<M>::_link_face(typename M::CFace *f, typename M::CHalfEdge *h0, typename M::CHalfEdge *h1, typename M::CHalfEdge *h2)
+	{
+		M::CHalfEdge *h[3] = {h0, h1, h2};
+		for (int i = 0; i < 3; i++)
+		{
+			h[i]->he_next() = h[(i + 1) % 3];
+			h[(i + 1) % 3]->he_prev() = h[i];
+			h[i]->face() = f;
+		}
+		f->halfedge() = h0;
+	}
+
 	template <typename M>
 	typename M::CVertex *CTriTopOper<M>::splitFace(typename M::CFace *pFace)
 	{
@@ -90,154 +120,108 @@ namespace MeshLib
 
 		M::CVertex *v[3];
 		M::CHalfEdge *h[3];
-		M::CHalfEdge *hs[3];
-
-		M::CEdge *eg[3];
 
+		// h[i] ends at v[i]: h[0] = v2->v0, h[1] = v0->v1, h[2] = v1->v2
 		h[0] = m_pMesh->faceHalfedge(pFace);
 		h[1] = m_pMesh->faceNextCcwHalfEdge(h[0]);
 		h[2] = m_pMesh->faceNextCcwHalfEdge(h[1]);
+		for (int i = 0; i < 3; i++)
+			v[i] = m_pMesh->halfedgeTarget(h[i]);
 
+		// a[i] = v[i] -> pV, b[i] = pV -> v[i+2]; face i is h[i], a[i], b[i]
+		M::CHalfEdge *a[3], *b[3];
+		M::CFace *f[3];
+		f[0] = pFace;
+		f[1] = m_pMesh->allocFace(++m_face_id);
+		f[2] = m_pMesh->allocFace(++m_face_id);
 		for (int i = 0; i < 3; i++)
 		{
-			v[i] = m_pMesh->halfedgeTarget(h[i]);
-			eg[i] = m_pMesh->halfedgeEdge(h[i]);
-			hs[i] = m_pMesh->halfedgeSym(h[i]);
+			a[i] = m_pMesh->allocHalfEdge();
+			b[i] = m_pMesh->allocHalfEdge();
+			a[i]->vertex() = pV;
+			b[i]->vertex() = v[(i + 2) % 3];
+			_link_face(f[i], h[i], a[i], b[i]);
 		}
 
-		// create two new faces using createFace so list/map are updated consistently
-		M::CVertex *fv1[3] = {v[0], v[1], pV};
-		M::CFace *f = m_pMesh->createFace(fv1, ++m_face_id);
-		M::CHalfEdge *hes[3];
-		hes[0] = m_pMesh->faceHalfedge(f);
-		hes[1] = m_pMesh->faceNextCcwHalfEdge(hes[0]);
-		hes[2] = m_pMesh->faceNextCcwHalfEdge(hes[1]);
-
-		M::CVertex *fv2[3] = {pV, v[1], v[2]};
-		f = m_pMesh->createFace(fv2, ++m_face_id);
-		M::CHalfEdge *hes2[3];
-		hes2[0] = m_pMesh->faceHalfedge(f);
-		hes2[1] = m_pMesh->faceNextCcwHalfEdge(hes2[0]);
-		hes2[2] = m_pMesh->faceNextCcwHalfEdge(hes2[1]);
-
-		// attach halfedges that must be connected to existing edges
-		_attach_halfedge_to_edge(h[0], hs[0], eg[0]);
-		_attach_halfedge_to_edge(hes[1], hs[1], eg[1]);
-		_attach_halfedge_to_edge(hes2[2], hs[2], eg[2]);
-
-		pV->halfedge() = h[1];
-
-		h[1]->vertex() = pV;
-		h[2]->vertex() = v[2];
-
-		hes[0]->vertex() = v[0];
-		hes[1]->vertex() = v[1];
-		hes[2]->vertex() = pV;
-
-		hes2[0]->vertex() = pV;
-		hes2[1]->vertex() = v[1];
-		hes2[2]->vertex() = v[2];
+		// the outer edges keep their end vertices; the three spokes are new
+		for (int i = 0; i < 3; i++)
+			_link_edge(a[i], b[(i + 1) % 3]);
 
-		v[0]->halfedge() = h[0];
-		v[1]->halfedge() = hes[1];
-		v[2]->halfedge() = hes2[2];
-		/*
-		for( int i = 0; i < 3; i ++ )
+		// a vertex whose most ccw in halfedge was h[i] now ends the ccw walk at b[i+1]
+		for (int i = 0; i < 3; i++)
 		{
-		v[i]->halfedge() = hs[i]->he_sym();
+			if (v[i]->halfedge() == h[i])
+				v[i]->halfedge() = b[(i + 1) % 3];
 		}
-		*/
+		pV->halfedge() = a[0];
 		return pV;
 	}
 
 	template <typename M>
 	typename M::CVertex *CTriTopOper<M>::splitEdge(typename M::CEdge *pEdge)
 	{
-		M::CVertex *pV = m_pMesh->createVertex(++m_vertex_id);
-
-		M::CHalfEdge *h[12];
-		M::CHalfEdge *s[6];
+		M::CHalfEdge *h[6];
 		M::CVertex *v[6];
-		M::CEdge *eg[6];
 
+		// h[0] = v2->v0, h[1] = v0->v1, h[2] = v1->v2 on one side,
+		// h[3] = v0->v2, h[4] = v2->v4, h[5] = v4->v0 on the other
 		h[0] = m_pMesh->edgeHalfedge(pEdge, 0);
+		h[3] = m_pMesh->edgeHalfedge(pEdge, 1);
+		if (h[3] == NULL)
+		{
+			std::cerr << "Error: Cannot split boundary edge" << std::endl;
+			return NULL;
+		}
 		h[1] = m_pMesh->faceNextCcwHalfEdge(h[0]);
 		h[2] = m_pMesh->faceNextCcwHalfEdge(h[1]);
-
-		h[3] = m_pMesh->edgeHalfedge(pEdge, 1);
 		h[4] = m_pMesh->faceNextCcwHalfEdge(h[3]);
 		h[5] = m_pMesh->faceNextCcwHalfEdge(h[4]);
+		for (int i = 0; i < 6; i++)
+			v[i] = m_pMesh->halfedgeVertex(h[i]);
+
+		M::CVertex *pV = m_pMesh->createVertex(++m_vertex_id);
 
 		M::CFace *f[4];
 		f[0] = m_pMesh->halfedgeFace(h[0]);
 		f[1] = m_pMesh->halfedgeFace(h[3]);
+		f[2] = m_pMesh->allocFace(++m_face_id);
+		f[3] = m_pMesh->allocFace(++m_face_id);
 
-		for (int ii = 0; ii < 6; ii++)
-		{
-			eg[ii] = m_pMesh->halfedgeEdge(h[ii]);
-			v[ii] = m_pMesh->halfedgeVertex(h[ii]);
-			s[ii] = m_pMesh->halfedgeSym(h[ii]);
-		}
-
-		// create two new faces using createFace so mesh lists/maps and edges are handled
-		M::CVertex *fv2[3] = {v[1], v[2], pV};
-		f[2] = m_pMesh->createFace(fv2, ++m_face_id);
-		// new halfedges h[6], h[7], h[8]
-		h[6] = m_pMesh->faceHalfedge(f[2]);
-		h[7] = m_pMesh->faceNextCcwHalfEdge(h[6]);
-		h[8] = m_pMesh->faceNextCcwHalfEdge(h[7]);
-
-		M::CVertex *fv3[3] = {v[2], v[4], pV};
-		f[3] = m_pMesh->createFace(fv3, ++m_face_id);
-		// new halfedges h[9], h[10], h[11]
-		h[9] = m_pMesh->faceHalfedge(f[3]);
-		h[10] = m_pMesh->faceNextCcwHalfEdge(h[9]);
-		h[11] = m_pMesh->faceNextCcwHalfEdge(h[10]);
-
-		// attach newly created face halfedges to existing edges where necessary
-		_attach_halfedge_to_edge(h[0], h[3], eg[0]);
-		_attach_halfedge_to_edge(h[1], s[1], eg[1]);
-		_attach_halfedge_to_edge(h[5], s[5], eg[5]);
-
-		_attach_halfedge_to_edge(h[7], s[2], eg[2]);
-		_attach_halfedge_to_edge(h[10], s[4], eg[4]);
+		M::CHalfEdge *n[6];
+		for (int i = 0; i < 6; i++)
+			n[i] = m_pMesh->allocHalfEdge();
 
-		h[0]->vertex() = v[0];
-		h[1]->vertex() = v[1];
-		h[2]->vertex() = pV;
+		// pEdge keeps the v0 half: h[0] = pV->v0, h[3] = v0->pV
+		m_pMesh->unindexEdge(pEdge);
+		m_pMesh->vertexEdges(v[0]->id() < v[2]->id() ? v[0] : v[2]).remove(pEdge);
 		h[3]->vertex() = pV;
-		h[4]->vertex() = v[4];
-		h[5]->vertex() = v[5];
-		h[6]->vertex() = v[1];
-		h[7]->vertex() = v[2];
-		h[8]->vertex() = pV;
-		h[9]->vertex() = v[2];
-		h[10]->vertex() = v[4];
-		h[11]->vertex() = pV;
-
-		v[0]->halfedge() = h[0];
-		v[1]->halfedge() = h[1];
-		v[2]->halfedge() = h[7];
-		v[4]->halfedge() = h[4];
-		pV->halfedge() = h[3];
-
-		for (int k = 0; k < 4; k++)
-		{
-			M::CHalfEdge *pH = m_pMesh->faceHalfedge(f[k]);
-			for (int i = 0; i < 3; i++)
-			{
-				if (pH->he_sym() != NULL)
-					assert(pH->vertex() == pH->he_sym()->he_prev()->vertex());
-				pH = m_pMesh->faceNextCcwHalfEdge(pH);
-			}
-		}
-
-		/*if (pEdge->fixed())
-		{
-			e[1]->fixed() = true;
-		}
-		e[1]->sharp() = true;*/
 
+		n[0]->vertex() = pV;   // v1 -> pV
+		n[1]->vertex() = pV;   // v2 -> pV
+		n[2]->vertex() = v[1]; // pV -> v1
+		n[3]->vertex() = v[4]; // pV -> v4
+		n[4]->vertex() = v[2]; // pV -> v2
+		n[5]->vertex() = pV;   // v4 -> pV
+
+		_link_face(f[0], h[0], h[1], n[0]);
+		_link_face(f[2], n[1], n[2], h[2]);
+		_link_face(f[1], h[3], n[3], h[5]);
+		_link_face(f[3], n[4], h[4], n[5]);
+
+		m_pMesh->vertexEdges(v[0]->id() < pV->id() ? v[0] : pV).push_back(pEdge);
+		m_pMesh->indexEdge(pEdge);
+		_link_edge(n[0], n[2]);
+		_link_edge(n[1], n[4]);
+		_link_edge(n[3], n[5]);
+
+		// keep the most ccw in halfedge of the vertices whose one changed face
+		if (v[1]->halfedge() == h[1])
+			v[1]->halfedge() = n[2];
+		if (v[2]->halfedge() == h[3])
+			v[2]->halfedge() = n[4];
+		if (v[4]->halfedge() == h[4])
+			v[4]->halfedge() = n[3];
+		pV->halfedge() = h[3];
 		return pV;
 	}
 
@@ -279,43 +263,55 @@ namespace MeshLib
 		pv[3] = static_cast<M::CVertex *>(m_pMesh->halfedgeTarget(ph[4])); // 右三角形第三个顶点
 
 		// 检查是否会产生重边
-		if (pv[2] == pv[3])
+		if (pv[2] == pv[3] || m_pMesh->vertexEdge(pv[2], pv[3]) != NULL)
 		{
 			std::cerr << "Error: Edge swap would create degenerate triangle" << std::endl;
 			return;
 		}
 
 		// 交换后的边连接 v3 和 v4
-
-		// 修改半边的目标顶点（target vertex）
-		// 左三角形：v3 -> v4 -> v1
-		ph[0]->target() = pv[3];
-		ph[0]->target() = pv[3]; // v3 -> v4
-		ph[1]->target() = pv[0]; // v4 -> v1
-		ph[2]->target() = pv[2]; // v1 -> v3
-
-		ph[3]->target() = pv[2]; // v4 -> v3
-		ph[4]->target() = pv[1]; // v3 -> v2
-		ph[5]->target() = pv[3]; // v2 -> v4
-
-		// 更新顶点的半边指针，确保每个顶点都指向一个以它为source的有效半边
-		// 需要检查原来的半边指针是否仍然有效
-		if (pv[0]->halfedge() == ph[0] || pv[0]->halfedge() == ph[3])
-		{
-			pv[0]->halfedge() = ph[1]; // v1的出边
-		}
-		if (pv[1]->halfedge() == ph[0] || pv[1]->halfedge() == ph[3])
-		{
-			pv[1]->halfedge() = ph[4]; // v2的出边
-		}
-		if (pv[2]->halfedge() == NULL || pv[2]->halfedge()->target() != pv[2])
-		{
-			pv[2]->halfedge() = ph[0]; // v3的出边（交换后的边）
-		}
-		if (pv[3]->halfedge() == NULL || pv[3]->halfedge()->target() != pv[3])
-		{
-			pv[3]->halfedge() = ph[3]; // v4的出边（交换后的边）
-		}
+		// 原来: 左 v1 -> v2 -> v3, 右 v2 -> v1 -> v4
+		// 交换: 左 v3 -> v1 -> v4, 右 v4 -> v2 -> v3
+		// 四条外围半边保持原来的边和目标顶点, 只有 ph[0], ph[3] 改变目标顶点
+		M::CFace *pf[2];
+		pf[0] = static_cast<M::CFace *>(m_pMesh->halfedgeFace(ph[0]));
+		pf[1] = static_cast<M::CFace *>(m_pMesh->halfedgeFace(ph[3]));
+
+		m_pMesh->unindexEdge(pEdge);
+		std::list<M::CEdge *> &old_edges = m_pMesh->vertexEdges(pv[0]->id() < pv[1]->id() ? pv[0] : pv[1]);
+		old_edges.remove(pEdge);
+
+		ph[0]->target() = pv[2]; // v4 -> v3
+		ph[3]->target() = pv[3]; // v3 -> v4
+
+		// 左三角形: ph[2] (v3 -> v1), ph[4] (v1 -> v4), ph[0] (v4 -> v3)
+		ph[2]->he_next() = ph[4];
+		ph[4]->he_next() = ph[0];
+		ph[0]->he_next() = ph[2];
+		// 右三角形: ph[5] (v4 -> v2), ph[1] (v2 -> v3), ph[3] (v3 -> v4)
+		ph[5]->he_next() = ph[1];
+		ph[1]->he_next() = ph[3];
+		ph[3]->he_next() = ph[5];
+		for (int i = 0; i < 6; i++)
+			ph[i]->he_next()->he_prev() = ph[i];
+
+		ph[4]->face() = pf[0];
+		ph[1]->face() = pf[1];
+		pf[0]->halfedge() = ph[0];
+		pf[1]->halfedge() = ph[3];
+
+		// 顶点的半边指向以它为target的半边; 替换后仍是最ccw的入边
+		if (pv[0]->halfedge() == ph[3])
+			pv[0]->halfedge() = ph[2];
+		if (pv[1]->halfedge() == ph[0])
+			pv[1]->halfedge() = ph[5];
+		if (pv[2]->halfedge() == ph[1])
+			pv[2]->halfedge() = ph[0];
+		if (pv[3]->halfedge() == ph[4])
+			pv[3]->halfedge() = ph[3];
+
+		m_pMesh->vertexEdges(pv[2]->id() < pv[3]->id() ? pv[2] : pv[3]).push_back(pEdge);
+		m_pMesh->indexEdge(pEdge);
 	}
 
 	template <typename M>
@@ -459,6 +455,7 @@ namespace MeshLib
 
 		// 交换边：将边的两个半边重新定向到v1和v2
 		// 通过修改半边的target指针实现
+		m_pMesh->unindexEdge(edge);
 		he_left->target() = (v1_in_left ? v2 : v1);
 		he_right->target() = (v1_in_left ? v1 : v2);
 
@@ -499,6 +496,8 @@ namespace MeshLib
 				}
 			}
 		}
+
+		m_pMesh->indexEdge(edge);
 	}
 
 	template <typename M>
@@ -506,26 +505,21 @@ namespace MeshLib
 	{
 		M::CVertex *pV = m_pMesh->createVertex(++m_vertex_id);
 
-		M::CFace *f = new M::CFace();
-		f->id() = ++m_face_id;
-		m_pMesh->faces().push_back(f);
-		m_pMesh->map_face().insert(pair<int, M::CFace *>(f->id(), f));
+		M::CFace *f = m_pMesh->allocFace(++m_face_id);
 
 		M::CHalfEdge *h[3];
 		M::CVertex *v[3];
 		M::CEdge *e[3];
 
 		e[0] = m_pMesh->halfedgeEdge(phe);
-		e[1] = new M::CEdge();
-		e[2] = new M::CEdge();
 
 		v[0] = m_pMesh->halfedgeSource(phe);
 		v[1] = pV;
 		v[2] = m_pMesh->halfedgeTarget(phe);
 
-		h[0] = new M::CHalfEdge();
-		h[1] = new M::CHalfEdge();
-		h[2] = new M::CHalfEdge();
+		h[0] = m_pMesh->allocHalfEdge();
+		h[1] = m_pMesh->allocHalfEdge();
+		h[2] = m_pMesh->allocHalfEdge();
 
 		/* link halfedges in one triangle */
 		for (int i = 0; i < 3; i++)
@@ -540,15 +534,17 @@ namespace MeshLib
 		}
 		f->halfedge() = h[0];
 		/* link halfedge with edge */
+		m_pMesh->unindexEdge(e[0]);
 		_attach_halfedge_to_edge(h[0], phe, e[0]);
-		_attach_halfedge_to_edge(h[1], NULL, e[1]);
-		_attach_halfedge_to_edge(h[2], NULL, e[2]);
 		/* link vertex and halfedge*/
 		h[0]->vertex() = v[0];
 		h[1]->vertex() = v[1];
 		h[2]->vertex() = v[2];
 		v[1]->halfedge() = h[1];
 		v[2]->halfedge() = h[2];
+		m_pMesh->indexEdge(e[0]);
+		e[1] = _link_edge(h[1], NULL);
+		e[2] = _link_edge(h[2], NULL);
 		/* tag boundary */
 		pV->boundary() = true;
 		/* return */
@@ -558,10 +554,7 @@ namespace MeshLib
 	template <typename M>
 	typename M::CHalfEdge *CTriTopOper<M>::addFace2Boundary(typename M::CHalfEdge *phe)
 	{
-		M::CFace *f = new M::CFace();
-		f->id() = ++m_face_id;
-		m_pMesh->faces().push_back(f);
-		m_pMesh->map_face().insert(pair<int, M::CFace *>(f->id(), f));
+		M::CFace *f = m_pMesh->allocFace(++m_face_id);
 
 		M::CVertex *v[3];
 		M::CHalfEdge *hs[2];
@@ -573,11 +566,10 @@ namespace MeshLib
 		hs[0] = phe;
 		hs[1] = m_pMesh->vertexMostClwOutHalfEdge(v[2]);
 		v[1] = m_pMesh->halfedgeTarget(hs[1]);
-		h[0] = new M::CHalfEdge();
-		h[1] = new M::CHalfEdge();
-		h[2] = new M::CHalfEdge();
+		h[0] = m_pMesh->allocHalfEdge();
+		h[1] = m_pMesh->allocHalfEdge();
+		h[2] = m_pMesh->allocHalfEdge();
 		e[0] = m_pMesh->halfedgeEdge(phe);
-		e[1] = new M::CEdge();
 		e[2] = m_pMesh->halfedgeEdge(hs[1]);
 
 		/* link halfedges in one triangle */
@@ -593,14 +585,18 @@ namespace MeshLib
 		}
 		f->halfedge() = h[0];
 		/* link halfedge with edge */
+		m_pMesh->unindexEdge(e[0]);
+		m_pMesh->unindexEdge(e[2]);
 		_attach_halfedge_to_edge(h[0], hs[0], e[0]);
-		_attach_halfedge_to_edge(h[1], NULL, e[1]);
 		_attach_halfedge_to_edge(h[2], hs[1], e[2]);
 		/* link vertex and halfedge*/
 		h[0]->vertex() = v[0];
 		h[1]->vertex() = v[1];
 		h[2]->vertex() = v[2];
 		v[1]->halfedge() = h[1];
+		m_pMesh->indexEdge(e[0]);
+		m_pMesh->indexEdge(e[2]);
+		e[1] = _link_edge(h[1], NULL);
 		/* untag boudnary vertex*/
 		v[2]->boundary() = false;
 		/* return */
@@ -1,13 +1,22 @@
 #include <iostream>
+#include <string>
 
 #include "ToolMesh.h"
 #include "OctreeSMC.h"
+#include "OctreeBench.h"
 
 using namespace std;
 using namespace MeshLib;
 
 void main(int argc, char **argv)
 {
+	if (argc > 1 && string(argv[1]) == "-bench")
+	{
+		bench_field_paths(6, 9);
+		bench_corner_layout(8, 9);
+		return;
+	}
+
 	double radius = 1.0;
 	auto sphere = [radius](const CPoint &p)
 	{